@@ -0,0 +1,42 @@
+/*
+    libFuzzer entry point for Inflater::feed.
+    The first byte picks zlib or raw deflate and the slice size, the rest is the stream.
+    It is inflated in one piece and in slices, resuming at any point has to give the same result.
+*/
+#include "Inflater.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+static Inflater::Status inflate(const u8* data,size_t size,bool zlibStream,size_t sliceSize,std::vector<u8>& output){
+    Inflater inflater([&output](const u8* out,size_t count){
+        //cap what is kept so a tiny input cant grow the output without bound
+        if(output.size() < ((size_t)16 << 20)){
+            output.insert(output.end(),out,out + count);
+        }
+    },zlibStream);
+    Inflater::Status status = Inflater::INFLATE_NEED_INPUT;
+    for(size_t offset=0;offset<size && status == Inflater::INFLATE_NEED_INPUT;offset+=sliceSize){
+        status = inflater.feed(data + offset,std::min(sliceSize,size - offset));
+    }
+    return status;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data,size_t size){
+    if(size < 1){
+        return 0;
+    }
+    bool zlibStream = (data[0] & 0x80) == 0;
+    size_t sliceSize = 1 + (data[0] & 0x7f);
+    std::vector<u8> whole;
+    std::vector<u8> sliced;
+    Inflater::Status wholeStatus = inflate(data + 1,size - 1,zlibStream,size,whole);
+    Inflater::Status slicedStatus = inflate(data + 1,size - 1,zlibStream,sliceSize,sliced);
+    //an error can be found at a different byte, everything else has to match
+    if((wholeStatus == Inflater::INFLATE_ERROR) != (slicedStatus == Inflater::INFLATE_ERROR) ||
+       (wholeStatus != Inflater::INFLATE_ERROR && whole != sliced)){
+        abort();
+    }
+    return 0;
+}
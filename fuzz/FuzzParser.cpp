@@ -0,0 +1,11 @@
+//libFuzzer entry point for Parser::parse (through parseBuffer, parse only adds reading the file)
+#include "Parser.h"
+#include <cstdint>
+#include <cstddef>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data,size_t size){
+    Parser parser;
+    ParsedData parsedData;
+    parser.parseBuffer((const char*)data,size,parsedData);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+    main() for the fuzz targets when libFuzzer is not available (gcc).
+    Every file given on the command line is run through LLVMFuzzerTestOneInput as it is,
+    then -runs=N mutated copies of them (bytes flipped, inserted, removed and the input cut short)
+    with a fixed seed so a crash can be reproduced by running the same command again.
+    Built with the sanitizers this is a regression run over a corpus, not a coverage guided fuzzer.
+*/
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data,size_t size);
+
+//mutated inputs are cut to this so large corpus files dont make every run slow
+static const size_t maxMutatedSize = (size_t)1 << 16;
+
+static void mutate(std::vector<uint8_t>& input,std::mt19937& random){
+    uint32_t count = 1 + random() % 8;
+    for(uint32_t i=0;i<count;i++){
+        size_t position = input.empty() ? 0 : random() % input.size();
+        switch(random() % 4){
+            case 0:
+                if(!input.empty())input[position] ^= (uint8_t)(1 << (random() % 8));
+                break;
+            case 1:
+                if(!input.empty())input[position] = (uint8_t)random();
+                break;
+            case 2:
+                input.insert(input.begin() + position,(uint8_t)random());
+                break;
+            case 3:
+                input.resize(position);
+                break;
+        }
+    }
+}
+
+int main(int argc,char* argv[]){
+    unsigned long runs = 0;
+    std::vector<std::vector<uint8_t>> corpus;
+    for(int i=1;i<argc;i++){
+        if(std::strncmp(argv[i],"-runs=",6) == 0){
+            runs = std::strtoul(argv[i] + 6,nullptr,10);
+            continue;
+        }
+        std::ifstream file(argv[i],std::ios::binary);
+        if(!file){
+            std::cerr << "Failed to open " << argv[i] << "\n";
+            return 1;
+        }
+        std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)),std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(input.data(),input.size());
+        corpus.push_back(input);
+    }
+    if(corpus.empty()){
+        corpus.push_back({});
+    }
+    std::mt19937 random(1);
+    for(unsigned long run=0;run<runs;run++){
+        std::vector<uint8_t> input = corpus[run % corpus.size()];
+        if(input.size() > maxMutatedSize){
+            input.resize(maxMutatedSize);
+        }
+        mutate(input,random);
+        LLVMFuzzerTestOneInput(input.data(),input.size());
+    }
+    std::cout << "Ran " << corpus.size() << " inputs and " << runs << " mutations\n";
+    return 0;
+}
@@ -0,0 +1,462 @@
+#include "APNGDecoder.h"
+#include "Defilter.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static u32 readBigEndian32(const u8* data){
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | (u32)data[3];
+}
+
+static u32 readBigEndian16(const u8* data){
+    return ((u32)data[0] << 8) | (u32)data[1];
+}
+
+static bool fail(const char* message){
+    std::cerr << "APNG decode error: " << message << "\n";
+    return false;
+}
+
+APNGDecoder::APNGDecoder()
+:file(nullptr),fileSize(0),pixelBytes(0),playCount(0)
+{
+    //the whole canvas is kept, so it gets the in memory image limit
+    limits.maxImageBytes = defaultMaxImageBytes;
+}
+
+void APNGDecoder::setLimits(const DecodeLimits& _limits){
+    limits = _limits;
+}
+
+const ImageHeader& APNGDecoder::getHeader() const{
+    return header;
+}
+
+u32 APNGDecoder::getFrameCount() const{
+    return (u32)frames.size();
+}
+
+u32 APNGDecoder::getPlayCount() const{
+    return playCount;
+}
+
+const APNGFrame& APNGDecoder::getFrame(u32 index) const{
+    return frames[index];
+}
+
+bool APNGDecoder::open(const u8* data,size_t size){
+    file = data;
+    fileSize = size;
+    frames.clear();
+    const unsigned char pngHeader[8] = {
+        0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    if(size < 8 || std::memcmp(data,pngHeader,8) != 0){
+        return fail("not a valid PNG file");
+    }
+
+    bool headerRead = false;
+    bool animated = false;
+    u32 declaredFrames = 0;
+    u32 nextSequence = 0;
+    //IDAT is only part of the animation when an fcTL comes before it
+    bool idatIsFrame = false;
+    std::vector<std::pair<size_t,u32>> stillSegments;
+
+    size_t offset = 8;
+    while(offset + 8 <= size){
+        u32 length = readBigEndian32(data + offset);
+        const u8* type = data + offset + 4;
+        size_t dataOffset = offset + 8;
+        if(length > size - dataOffset || size - dataOffset - length < 4){
+            return fail("chunk runs past the end of the file");
+        }
+        const u8* chunk = data + dataOffset;
+        if(std::memcmp(type,"IHDR",4) == 0){
+            if(length != 13){
+                return fail("IHDR chunk has the wrong length");
+            }
+            header.width = readBigEndian32(chunk);
+            header.height = readBigEndian32(chunk + 4);
+            header.bpp = chunk[8];
+            header.colorType = chunk[9];
+            header.compressionMethod = chunk[10];
+            header.filterMethod = chunk[11];
+            header.interlaceMethod = chunk[12];
+            bool supported = (
+                (header.bpp == 8) &&
+                (header.colorType == 2 || header.colorType == 6) &&
+                (header.filterMethod == 0) &&
+                (header.interlaceMethod == 0) &&
+                (header.compressionMethod == 0)
+            );
+            if(!supported){
+                return fail("PNG file is not supported (only 8 bit non interlaced Truecolor and Truecolor and Alpha)");
+            }
+            if(header.width == 0 || header.height == 0){
+                return fail("image has no pixels");
+            }
+            if(header.width > 0x7fffffff || header.height > 0x7fffffff){
+                return fail("image width or height is over 2^31-1");
+            }
+            //RGBA canvas, compared by division so it cant wrap. Every frame lies inside it
+            //so these bound every region and row buffer as well
+            u64 canvasRowBytes = (u64)header.width*4;
+            if(canvasRowBytes > limits.maxRowBytes || canvasRowBytes > limits.maxImageBytes/header.height){
+                return fail("canvas is larger than the decode limit");
+            }
+            pixelBytes = (header.colorType == 6) ? 4 : 3;
+            headerRead = true;
+        }else if(!headerRead){
+            return fail("first chunk is not IHDR");
+        }else if(std::memcmp(type,"acTL",4) == 0){
+            if(length != 8){
+                return fail("acTL chunk has the wrong length");
+            }
+            animated = true;
+            declaredFrames = readBigEndian32(chunk);
+            playCount = readBigEndian32(chunk + 4);
+        }else if(std::memcmp(type,"fcTL",4) == 0){
+            if(length != 26){
+                return fail("fcTL chunk has the wrong length");
+            }
+            if(readBigEndian32(chunk) != nextSequence++){
+                return fail("fcTL sequence number out of order");
+            }
+            APNGFrame frame;
+            frame.width = readBigEndian32(chunk + 4);
+            frame.height = readBigEndian32(chunk + 8);
+            frame.xOffset = readBigEndian32(chunk + 12);
+            frame.yOffset = readBigEndian32(chunk + 16);
+            frame.delayNum = readBigEndian16(chunk + 20);
+            frame.delayDen = readBigEndian16(chunk + 22);
+            frame.disposeOp = chunk[24];
+            frame.blendOp = chunk[25];
+            if(frame.width == 0 || frame.height == 0 ||
+               (u64)frame.xOffset + frame.width > header.width ||
+               (u64)frame.yOffset + frame.height > header.height){
+                return fail("frame lies outside the canvas");
+            }
+            if(frame.disposeOp > APNG_DISPOSE_PREVIOUS || frame.blendOp > APNG_BLEND_OVER){
+                return fail("invalid dispose or blend op");
+            }
+            if(frames.empty() && stillSegments.empty()){
+                idatIsFrame = true;
+            }
+            frames.push_back(frame);
+        }else if(std::memcmp(type,"IDAT",4) == 0){
+            if(idatIsFrame && frames.size() == 1){
+                frames[0].segments.push_back({dataOffset,length});
+            }else if(frames.empty()){
+                stillSegments.push_back({dataOffset,length});
+            }
+        }else if(std::memcmp(type,"fdAT",4) == 0){
+            if(length < 4){
+                return fail("fdAT chunk has the wrong length");
+            }
+            if(readBigEndian32(chunk) != nextSequence++){
+                return fail("fdAT sequence number out of order");
+            }
+            if(frames.empty() || (idatIsFrame && frames.size() == 1)){
+                return fail("fdAT chunk without a frame");
+            }
+            frames.back().segments.push_back({dataOffset + 4,length - 4});
+        }else if(std::memcmp(type,"IEND",4) == 0){
+            break;
+        }
+        offset = dataOffset + length + 4;
+    }
+    if(!headerRead){
+        return fail("no IHDR chunk");
+    }
+
+    if(!animated){
+        //a plain png is one frame covering the canvas
+        frames.clear();
+        APNGFrame frame;
+        frame.width = header.width;
+        frame.height = header.height;
+        frame.segments = stillSegments;
+        frames.push_back(frame);
+        playCount = 1;
+    }
+    if(frames.empty() || (animated && frames.size() != declaredFrames)){
+        return fail("acTL frame count does not match the fcTL chunks");
+    }
+    for(const APNGFrame& frame : frames){
+        if(frame.segments.empty()){
+            return fail("frame without image data");
+        }
+    }
+    //the canvas before the first frame is transparent black, so restoring it is the same as clearing it
+    if(frames[0].disposeOp == APNG_DISPOSE_PREVIOUS){
+        frames[0].disposeOp = APNG_DISPOSE_BACKGROUND;
+    }
+
+    //A frame's key frame is the first frame its canvas can be rebuilt from: one drawn on a
+    //clear canvas or one that replaces the whole canvas
+    u32 canvasBefore = 0;   //key frame of the canvas each frame is drawn on
+    for(u32 i=0;i<frames.size();i++){
+        APNGFrame& frame = frames[i];
+        bool fullCanvas = frame.width == header.width && frame.height == header.height;
+        bool replaces = fullCanvas && frame.blendOp == APNG_BLEND_SOURCE;
+        frame.keyFrame = replaces ? i : canvasBefore;
+        if(frame.disposeOp == APNG_DISPOSE_NONE){
+            canvasBefore = frame.keyFrame;
+        }else if(frame.disposeOp == APNG_DISPOSE_BACKGROUND){
+            canvasBefore = fullCanvas ? i + 1 : frame.keyFrame;
+        }
+        //dispose previous goes back to the canvas this frame was drawn on
+    }
+    return true;
+}
+
+bool APNGDecoder::decodeFrameRegion(u32 index,std::vector<u8>& rgba) const{
+    if(index >= frames.size()){
+        return fail("frame index out of range");
+    }
+    const APNGFrame& frame = frames[index];
+    const size_t rowBytes = (size_t)frame.width*pixelBytes;
+    const size_t rgbaRowBytes = (size_t)frame.width*4;
+    rgba.resize(rgbaRowBytes*frame.height);
+
+    std::vector<u8> filteredRow(rowBytes + 1);
+    std::vector<u8> prevRow(rowBytes,0);
+    std::vector<u8> currentRow(rowBytes,0);
+    size_t rowFill = 0;
+    u32 y = 0;
+    bool badFilter = false;
+    //same scanline splitting as StreamDecoder, rows are widened to RGBA as they complete
+    Inflater inflater([&](const u8* data,size_t size){
+        const u8* reader = data;
+        const u8* end = data + size;
+        while(reader < end && y < frame.height && !badFilter){
+            size_t count = std::min<size_t>(filteredRow.size() - rowFill,end - reader);
+            std::memcpy(filteredRow.data() + rowFill,reader,count);
+            rowFill += count;
+            reader += count;
+            if(rowFill < filteredRow.size()){
+                return;
+            }
+            u8 filterType = filteredRow[0];
+            if(filterType > 4){
+                badFilter = true;
+                return;
+            }
+            defilterScanline(filteredRow.data() + 1,filterType,(y>0?prevRow.data():nullptr),currentRow.data(),rowBytes,pixelBytes);
+            u8* out = rgba.data() + (size_t)y*rgbaRowBytes;
+            if(pixelBytes == 4){
+                std::memcpy(out,currentRow.data(),rowBytes);
+            }else{
+                for(u32 x=0;x<frame.width;x++){
+                    out[x*4+0] = currentRow[x*3+0];
+                    out[x*4+1] = currentRow[x*3+1];
+                    out[x*4+2] = currentRow[x*3+2];
+                    out[x*4+3] = 255;
+                }
+            }
+            std::swap(prevRow,currentRow);
+            y++;
+            rowFill = 0;
+        }
+    });
+    Inflater::Status status = Inflater::INFLATE_NEED_INPUT;
+    for(const std::pair<size_t,u32>& segment : frame.segments){
+        status = inflater.feed(file + segment.first,segment.second);
+        if(status == Inflater::INFLATE_ERROR){
+            return fail("corrupt frame data");
+        }
+        if(badFilter){
+            return fail("invalid filter type");
+        }
+        if(status == Inflater::INFLATE_DONE)break;
+    }
+    if(status != Inflater::INFLATE_DONE || y != frame.height){
+        return fail("frame data ended before the last scanline");
+    }
+    return true;
+}
+
+bool APNGDecoder::decodeRegions(const std::vector<u32>& indices,std::vector<std::vector<u8>>& regions,ThreadPool* pool) const{
+    regions.assign(indices.size(),std::vector<u8>());
+    std::vector<u8> ok(indices.size(),0);
+    if(indices.size() > 1 && pool){
+        for(size_t i=0;i<indices.size();i++){
+            pool->enqueue([this,&indices,&regions,&ok,i](){
+                ok[i] = decodeFrameRegion(indices[i],regions[i]) ? 1 : 0;
+            });
+        }
+        pool->wait();
+    }else{
+        for(size_t i=0;i<indices.size();i++){
+            ok[i] = decodeFrameRegion(indices[i],regions[i]) ? 1 : 0;
+        }
+    }
+    return std::find(ok.begin(),ok.end(),0) == ok.end();
+}
+
+bool APNGDecoder::decodeAll(const std::function<void(u32 index,const std::vector<u8>& canvas)>& onFrame,u32 threadCount) const{
+    std::unique_ptr<ThreadPool> pool;
+    if(frames.size() > 1 && threadCount != 1){
+        pool.reset(new ThreadPool(threadCount));
+    }
+    //regions are decoded a window at a time so only the window, the canvas
+    //and the saved canvas are resident however many frames there are
+    const u32 window = pool ? pool->size()*2 : 1;
+    std::vector<u8> canvas((size_t)header.width*header.height*4,0);
+    std::vector<u8> saved;
+    std::vector<u32> indices;
+    std::vector<std::vector<u8>> regions;
+    for(u32 first=0;first<frames.size();first+=window){
+        indices.clear();
+        for(u32 i=first;i<frames.size() && i<first+window;i++){
+            indices.push_back(i);
+        }
+        if(!decodeRegions(indices,regions,pool.get())){
+            return false;
+        }
+        for(size_t k=0;k<indices.size();k++){
+            u32 i = indices[k];
+            const APNGFrame& frame = frames[i];
+            if(frame.disposeOp == APNG_DISPOSE_PREVIOUS){
+                saved = canvas;
+            }
+            compositeFrame(canvas.data(),header.width,frame,regions[k].data());
+            //the region is not needed anymore
+            std::vector<u8>().swap(regions[k]);
+            onFrame(i,canvas);
+            if(frame.disposeOp == APNG_DISPOSE_BACKGROUND){
+                clearFrameArea(canvas.data(),header.width,frame);
+            }else if(frame.disposeOp == APNG_DISPOSE_PREVIOUS){
+                std::swap(canvas,saved);
+            }
+        }
+    }
+    return true;
+}
+
+bool APNGDecoder::decodeFrame(u32 index,std::vector<u8>& canvas,u32 threadCount) const{
+    if(index >= frames.size()){
+        return fail("frame index out of range");
+    }
+    //Between the key frame and index, frames disposed to the previous canvas leave nothing behind
+    //and frames disposed to the background only clear their rectangle, neither has to be decoded
+    u32 keyFrame = frames[index].keyFrame;
+    std::vector<u32> indices;
+    for(u32 i=keyFrame;i<=index;i++){
+        if(i == index || frames[i].disposeOp == APNG_DISPOSE_NONE){
+            indices.push_back(i);
+        }
+    }
+    std::vector<std::vector<u8>> regions;
+    std::unique_ptr<ThreadPool> pool;
+    if(indices.size() > 1 && threadCount != 1){
+        pool.reset(new ThreadPool(threadCount));
+    }
+    if(!decodeRegions(indices,regions,pool.get())){
+        return false;
+    }
+
+    canvas.assign((size_t)header.width*header.height*4,0);
+    size_t next = 0;
+    for(u32 i=keyFrame;i<=index;i++){
+        const APNGFrame& frame = frames[i];
+        if(next < indices.size() && indices[next] == i){
+            compositeFrame(canvas.data(),header.width,frame,regions[next].data());
+            next++;
+        }else if(frame.disposeOp == APNG_DISPOSE_BACKGROUND){
+            clearFrameArea(canvas.data(),header.width,frame);
+        }
+    }
+    return true;
+}
+
+//Alpha blending from the APNG spec, both pixels are not premultiplied
+static inline void blendPixelOver(u8* dst,const u8* src){
+    u32 srcAlpha = src[3];
+    if(srcAlpha == 255){
+        std::memcpy(dst,src,4);
+        return;
+    }
+    if(srcAlpha == 0){
+        return;
+    }
+    u32 u = srcAlpha*255;
+    u32 v = (255 - srcAlpha)*dst[3];
+    u32 alpha = u + v;
+    for(u32 c=0;c<3;c++){
+        dst[c] = (u8)((src[c]*u + dst[c]*v)/alpha);
+    }
+    dst[3] = (u8)(alpha/255);
+}
+
+#ifdef __SSE2__
+//src*a + dst*(255-a) for the two pixels in 16 bit lanes, divided by 255 (exact floor for values up to 65025)
+static inline __m128i blendOpaque16(__m128i src,__m128i dst){
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(src,alpha),_mm_mullo_epi16(dst,_mm_sub_epi16(full,alpha)));
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sum,one),_mm_srli_epi16(sum,8)),8);
+}
+#endif
+
+static void blendRowOver(u8* dst,const u8* src,u32 count){
+    u32 x = 0;
+#ifdef __SSE2__
+    //4 pixels at a time, groups that are fully opaque or fully transparent are a copy or a skip,
+    //groups over an opaque canvas are blended in 16 bit lanes
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+    for(;x+4<=count;x+=4){
+        __m128i source = _mm_loadu_si128((const __m128i*)(src + x*4));
+        __m128i sourceAlpha = _mm_and_si128(source,alphaMask);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha,alphaMask)) == 0xffff){
+            _mm_storeu_si128((__m128i*)(dst + x*4),source);
+            continue;
+        }
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(sourceAlpha,zero)) == 0xffff){
+            continue;
+        }
+        __m128i target = _mm_loadu_si128((const __m128i*)(dst + x*4));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(target,alphaMask),alphaMask)) == 0xffff){
+            __m128i low = blendOpaque16(_mm_unpacklo_epi8(source,zero),_mm_unpacklo_epi8(target,zero));
+            __m128i high = blendOpaque16(_mm_unpackhi_epi8(source,zero),_mm_unpackhi_epi8(target,zero));
+            //blending over an opaque pixel stays opaque
+            _mm_storeu_si128((__m128i*)(dst + x*4),_mm_or_si128(_mm_packus_epi16(low,high),alphaMask));
+            continue;
+        }
+        for(u32 i=0;i<4;i++){
+            blendPixelOver(dst + (x+i)*4,src + (x+i)*4);
+        }
+    }
+#endif
+    for(;x<count;x++){
+        blendPixelOver(dst + x*4,src + x*4);
+    }
+}
+
+void compositeFrame(u8* canvas,u32 canvasWidth,const APNGFrame& frame,const u8* region){
+    const size_t regionRowBytes = (size_t)frame.width*4;
+    for(u32 y=0;y<frame.height;y++){
+        u8* dst = canvas + ((size_t)(frame.yOffset + y)*canvasWidth + frame.xOffset)*4;
+        const u8* src = region + (size_t)y*regionRowBytes;
+        if(frame.blendOp == APNG_BLEND_SOURCE){
+            std::memcpy(dst,src,regionRowBytes);
+        }else{
+            blendRowOver(dst,src,frame.width);
+        }
+    }
+}
+
+void clearFrameArea(u8* canvas,u32 canvasWidth,const APNGFrame& frame){
+    for(u32 y=0;y<frame.height;y++){
+        u8* dst = canvas + ((size_t)(frame.yOffset + y)*canvasWidth + frame.xOffset)*4;
+        std::memset(dst,0,(size_t)frame.width*4);
+    }
+}
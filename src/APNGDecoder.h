@@ -0,0 +1,83 @@
+#ifndef APNGDECODER
+#define APNGDECODER
+
+#include <vector>
+#include <functional>
+#include "StreamDecoder.h"
+
+class ThreadPool;
+
+enum APNGDisposeOp{
+    APNG_DISPOSE_NONE=0,
+    APNG_DISPOSE_BACKGROUND,
+    APNG_DISPOSE_PREVIOUS
+};
+
+enum APNGBlendOp{
+    APNG_BLEND_SOURCE=0,
+    APNG_BLEND_OVER
+};
+
+//One fcTL with the IDAT or fdAT payloads that belong to it
+struct APNGFrame{
+    u32 width=0;
+    u32 height=0;
+    u32 xOffset=0;
+    u32 yOffset=0;
+    u32 delayNum=0;
+    u32 delayDen=0;
+    u8 disposeOp=APNG_DISPOSE_NONE;
+    u8 blendOp=APNG_BLEND_SOURCE;
+    //offset and length in the file of every data segment (fdAT without its sequence number)
+    std::vector<std::pair<size_t,u32>> segments;
+    //first frame whose canvas can be built without anything before it
+    u32 keyFrame=0;
+};
+
+/*
+    Animated png decoder.
+    open() builds the frame index in one pass over the chunks without inflating anything,
+    every frame is its own zlib stream so frames are inflated and defiltered in parallel,
+    the dispose/blend compositing onto the canvas runs afterwards in order.
+    Canvases are RGBA, 8 bit Truecolor and Truecolor and Alpha are supported.
+    The file data has to stay alive while the decoder is used.
+*/
+class APNGDecoder{
+    public:
+    APNGDecoder();
+    //has to be set before open(), the canvas (width*height*4) is checked against maxImageBytes (1GiB by default)
+    void setLimits(const DecodeLimits& _limits);
+    bool open(const u8* data,size_t size);
+    const ImageHeader& getHeader() const;
+    u32 getFrameCount() const;
+    //0 = loop forever
+    u32 getPlayCount() const;
+    const APNGFrame& getFrame(u32 index) const;
+
+    //Inflates and defilters the frame's own rectangle into RGBA, no compositing
+    bool decodeFrameRegion(u32 index,std::vector<u8>& rgba) const;
+    //Every composited canvas in order, onFrame gets the canvas only for the duration of the call.
+    //threadCount 0 = one thread per core
+    bool decodeAll(const std::function<void(u32 index,const std::vector<u8>& canvas)>& onFrame,u32 threadCount = 0) const;
+    //Composited canvas of one frame, only the frames back to its key frame that still show are decoded
+    bool decodeFrame(u32 index,std::vector<u8>& canvas,u32 threadCount = 0) const;
+
+    private:
+    const u8* file;
+    size_t fileSize;
+    DecodeLimits limits;
+    ImageHeader header;
+    u32 pixelBytes;
+    u32 playCount;
+    std::vector<APNGFrame> frames;
+
+    //in parallel on pool, one after another without one
+    bool decodeRegions(const std::vector<u32>& indices,std::vector<std::vector<u8>>& regions,ThreadPool* pool) const;
+};
+
+//Blends one frame onto the canvas, canvas and region are RGBA
+void compositeFrame(u8* canvas,u32 canvasWidth,const APNGFrame& frame,const u8* region);
+//Clears the frame's rectangle to transparent black
+void clearFrameArea(u8* canvas,u32 canvasWidth,const APNGFrame& frame);
+
+#endif
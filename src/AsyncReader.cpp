@@ -0,0 +1,483 @@
+#include "AsyncReader.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PNGLOADER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+BufferPool::BufferPool(u32 count){
+    count = std::max(1u,count);
+    for(u32 i=0;i<count;i++){
+        buffers.emplace_back(new std::vector<char>());
+        freeBuffers.push_back(buffers.back().get());
+    }
+}
+
+std::vector<char>* BufferPool::acquire(){
+    std::unique_lock<std::mutex> lock(mutex);
+    bufferReturned.wait(lock,[this]{ return !freeBuffers.empty(); });
+    std::vector<char>* buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+std::vector<char>* BufferPool::tryAcquire(){
+    std::unique_lock<std::mutex> lock(mutex);
+    if(freeBuffers.empty()){
+        return nullptr;
+    }
+    std::vector<char>* buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(std::vector<char>* buffer){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        freeBuffers.push_back(buffer);
+    }
+    bufferReturned.notify_one();
+}
+
+void BufferPool::abandon(std::vector<char>* buffer){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(std::unique_ptr<std::vector<char>>& owned : buffers){
+            if(owned.get() == buffer){
+                //never freed, a late write from the kernel lands in memory nobody uses
+                (void)owned.release();
+                owned.reset(new std::vector<char>());
+                freeBuffers.push_back(owned.get());
+                break;
+            }
+        }
+    }
+    bufferReturned.notify_one();
+}
+
+u32 BufferPool::size() const{
+    return (u32)buffers.size();
+}
+
+#ifdef PNGLOADER_IO_URING
+//Submission and completion rings mapped from the kernel, set up with the raw syscalls (no liburing)
+struct AsyncFileReader::Ring{
+    int fd=-1;
+    u8* sqRing=nullptr;
+    u8* cqRing=nullptr;
+    size_t sqRingSize=0;
+    size_t cqRingSize=0;
+    io_uring_sqe* sqes=nullptr;
+    size_t sqesSize=0;
+    unsigned* sqTail=nullptr;
+    unsigned sqMask=0;
+    unsigned* sqArray=nullptr;
+    unsigned* cqHead=nullptr;
+    unsigned* cqTail=nullptr;
+    unsigned cqMask=0;
+    io_uring_cqe* cqes=nullptr;
+    unsigned pendingSubmits=0;
+
+    bool setup(u32 entries){
+        io_uring_params params;
+        std::memset(&params,0,sizeof(params));
+        fd = (int)syscall(__NR_io_uring_setup,entries,&params);
+        if(fd < 0){
+            return false;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(singleMap){
+            sqRingSize = cqRingSize = std::max(sqRingSize,cqRingSize);
+        }
+        void* sq = mmap(nullptr,sqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+        if(sq == MAP_FAILED){
+            return false;
+        }
+        sqRing = (u8*)sq;
+        if(singleMap){
+            cqRing = sqRing;
+        }else{
+            void* cq = mmap(nullptr,cqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+            if(cq == MAP_FAILED){
+                return false;
+            }
+            cqRing = (u8*)cq;
+        }
+        sqesSize = params.sq_entries*sizeof(io_uring_sqe);
+        void* entriesMap = mmap(nullptr,sqesSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQES);
+        if(entriesMap == MAP_FAILED){
+            return false;
+        }
+        sqes = (io_uring_sqe*)entriesMap;
+        sqTail = (unsigned*)(sqRing + params.sq_off.tail);
+        sqMask = *(unsigned*)(sqRing + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sqRing + params.sq_off.array);
+        cqHead = (unsigned*)(cqRing + params.cq_off.head);
+        cqTail = (unsigned*)(cqRing + params.cq_off.tail);
+        cqMask = *(unsigned*)(cqRing + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    ~Ring(){
+        if(sqes){
+            munmap(sqes,sqesSize);
+        }
+        if(cqRing && cqRing != sqRing){
+            munmap(cqRing,cqRingSize);
+        }
+        if(sqRing){
+            munmap(sqRing,sqRingSize);
+        }
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+
+    //the caller keeps the number in flight at or below the ring size, so there is always a free entry
+    void queueRead(int fileFd,const iovec* vector,unsigned long long offset,unsigned long long userData){
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe,0,sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fileFd;
+        sqe->addr = (unsigned long long)(uintptr_t)vector;
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail,tail + 1,__ATOMIC_RELEASE);
+        pendingSubmits++;
+    }
+
+    //asks the kernel to cancel the request queued with targetUserData
+    void queueCancel(unsigned long long targetUserData,unsigned long long userData){
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe,0,sizeof(*sqe));
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = targetUserData;
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail,tail + 1,__ATOMIC_RELEASE);
+        pendingSubmits++;
+    }
+
+    //submits the queued reads and waits for at least one completion
+    bool submitAndWait(){
+        while(true){
+            int result = (int)syscall(__NR_io_uring_enter,fd,pendingSubmits,1,IORING_ENTER_GETEVENTS,nullptr,0);
+            if(result >= 0){
+                pendingSubmits -= std::min<unsigned>(pendingSubmits,(unsigned)result);
+                return true;
+            }
+            if(errno != EINTR && errno != EAGAIN && errno != EBUSY){
+                return false;
+            }
+        }
+    }
+
+    template<typename Handler>
+    void reap(Handler handler){
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail,__ATOMIC_ACQUIRE);
+        while(head != tail){
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            handler(cqe.user_data,cqe.res);
+            head++;
+        }
+        __atomic_store_n(cqHead,head,__ATOMIC_RELEASE);
+    }
+};
+#else
+struct AsyncFileReader::Ring{};
+#endif
+
+AsyncFileReader::AsyncFileReader(BufferPool& _pool,u32 _queueDepth,bool allowIoUring)
+:pool(_pool),queueDepth(std::max(1u,_queueDepth))
+{
+#ifdef PNGLOADER_IO_URING
+    if(allowIoUring){
+        ring.reset(new Ring());
+        //room for a cancel next to every read in flight
+        if(!ring->setup(queueDepth*2)){
+            std::cerr << "io_uring is not available, reading with " << queueDepth << " threads\n";
+            ring.reset();
+        }
+    }
+#else
+    (void)allowIoUring;
+#endif
+}
+
+AsyncFileReader::~AsyncFileReader(){
+
+}
+
+bool AsyncFileReader::usingIoUring() const{
+    return ring != nullptr;
+}
+
+void AsyncFileReader::readFiles(const std::vector<std::string>& filepaths,const CompletionCallback& onComplete){
+#ifdef PNGLOADER_IO_URING
+    if(ring){
+        readWithRing(filepaths,onComplete);
+        return;
+    }
+#endif
+    std::vector<size_t> indices(filepaths.size());
+    for(size_t i=0;i<indices.size();i++){
+        indices[i] = i;
+    }
+    readWithThreads(filepaths,indices,onComplete);
+}
+
+#ifdef PNGLOADER_IO_URING
+void AsyncFileReader::readWithRing(const std::vector<std::string>& filepaths,const CompletionCallback& onComplete){
+    struct Slot{
+        int fd=-1;
+        size_t index=0;
+        size_t done=0;
+        std::vector<char>* buffer=nullptr;
+        iovec vector;
+    };
+    std::vector<Slot> slots(queueDepth);
+    std::vector<u32> freeSlots;
+    for(u32 i=0;i<queueDepth;i++){
+        freeSlots.push_back(queueDepth - 1 - i);
+    }
+    auto finish = [&](u32 slotIndex,bool ok){
+        Slot& slot = slots[slotIndex];
+        close(slot.fd);
+        if(!ok){
+            std::cerr << "Failed to read from file " << filepaths[slot.index] << "\n";
+            pool.release(slot.buffer);
+            onComplete(slot.index,nullptr);
+        }else{
+            onComplete(slot.index,slot.buffer);
+        }
+        slot.buffer = nullptr;
+        freeSlots.push_back(slotIndex);
+    };
+    auto queueRemainder = [&](u32 slotIndex){
+        Slot& slot = slots[slotIndex];
+        slot.vector.iov_base = slot.buffer->data() + slot.done;
+        slot.vector.iov_len = slot.buffer->size() - slot.done;
+        ring->queueRead(slot.fd,&slot.vector,slot.done,slotIndex);
+    };
+
+    size_t next = 0;
+    u32 inFlight = 0;
+    while(next < filepaths.size() || inFlight > 0){
+        //open and queue files while there is room in the ring and a free buffer
+        while(next < filepaths.size() && !freeSlots.empty()){
+            std::vector<char>* buffer = inFlight == 0 ? pool.acquire() : pool.tryAcquire();
+            if(!buffer){
+                break;
+            }
+            size_t index = next++;
+            int fd = open(filepaths[index].c_str(),O_RDONLY | O_CLOEXEC);
+            struct stat info;
+            if(fd < 0 || fstat(fd,&info) != 0){
+                std::cerr << "Failed to open file " << filepaths[index] << "\n";
+                if(fd >= 0){
+                    close(fd);
+                }
+                pool.release(buffer);
+                onComplete(index,nullptr);
+                continue;
+            }
+            buffer->resize((size_t)info.st_size);
+            u32 slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+            Slot& slot = slots[slotIndex];
+            slot.fd = fd;
+            slot.index = index;
+            slot.done = 0;
+            slot.buffer = buffer;
+            if(buffer->empty()){
+                finish(slotIndex,true);
+                continue;
+            }
+            queueRemainder(slotIndex);
+            inFlight++;
+        }
+        if(inFlight == 0){
+            continue;
+        }
+        if(!ring->submitAndWait()){
+            //the ring is dropped, files in flight and the rest are read with threads
+            std::cerr << "io_uring_enter failed, reading with " << queueDepth << " threads\n";
+            bool drained = cancelInFlight(slots.size(),inFlight,[&slots](u32 slotIndex){
+                return slots[slotIndex].buffer != nullptr;
+            });
+            //torn down before any buffer is touched again
+            ring.reset();
+            if(!drained){
+                std::cerr << "Reads in flight could not be cancelled, their buffers are not reused\n";
+            }
+            std::vector<size_t> remaining;
+            for(Slot& slot : slots){
+                if(slot.buffer){
+                    close(slot.fd);
+                    if(drained){
+                        pool.release(slot.buffer);
+                    }else{
+                        pool.abandon(slot.buffer);
+                    }
+                    slot.buffer = nullptr;
+                    remaining.push_back(slot.index);
+                }
+            }
+            for(;next<filepaths.size();next++){
+                remaining.push_back(next);
+            }
+            readWithThreads(filepaths,remaining,onComplete);
+            return;
+        }
+        ring->reap([&](unsigned long long userData,int result){
+            u32 slotIndex = (u32)userData;
+            Slot& slot = slots[slotIndex];
+            if(result <= 0){
+                inFlight--;
+                finish(slotIndex,false);
+                return;
+            }
+            slot.done += (size_t)result;
+            if(slot.done < slot.buffer->size()){
+                //short read, the rest goes back into the ring
+                queueRemainder(slotIndex);
+                return;
+            }
+            inFlight--;
+            finish(slotIndex,true);
+        });
+    }
+}
+/*
+    Cancels the reads of every slot where inFlight(slot) and reaps completions until each of them
+    has one (done, short or cancelled), after that the kernel no longer touches their buffers.
+    False if the ring fails again first.
+*/
+bool AsyncFileReader::cancelInFlight(size_t slotCount,u32 inFlight,const std::function<bool(u32 slotIndex)>& isInFlight){
+    //cancel completions carry the top bit so they arent counted as reads
+    const unsigned long long cancelTag = 1ull << 63;
+    u32 outstanding = inFlight;
+    auto countReads = [&outstanding,cancelTag](unsigned long long userData,int){
+        if((userData & cancelTag) == 0 && outstanding > 0){
+            outstanding--;
+        }
+    };
+    //reads that already finished are sitting in the completion ring
+    ring->reap(countReads);
+    for(u32 slotIndex=0;slotIndex<slotCount && outstanding > 0;slotIndex++){
+        if(isInFlight(slotIndex)){
+            ring->queueCancel(slotIndex,cancelTag | slotIndex);
+        }
+    }
+    while(outstanding > 0){
+        if(!ring->submitAndWait()){
+            return false;
+        }
+        ring->reap(countReads);
+    }
+    return true;
+}
+#else
+bool AsyncFileReader::cancelInFlight(size_t slotCount,u32 inFlight,const std::function<bool(u32 slotIndex)>& isInFlight){
+    (void)slotCount;
+    (void)isInFlight;
+    return inFlight == 0;
+}
+
+void AsyncFileReader::readWithRing(const std::vector<std::string>& filepaths,const CompletionCallback& onComplete){
+    (void)filepaths;
+    (void)onComplete;
+}
+#endif
+
+//Reads the whole file into buffer with blocking reads
+static bool readWholeFile(const std::string& filepath,std::vector<char>& buffer){
+#ifndef _WIN32
+    int fd = open(filepath.c_str(),O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd,&info) != 0){
+        close(fd);
+        return false;
+    }
+    buffer.resize((size_t)info.st_size);
+    size_t done = 0;
+    while(done < buffer.size()){
+        ssize_t result = pread(fd,buffer.data() + done,buffer.size() - done,(off_t)done);
+        if(result < 0 && errno == EINTR)continue;
+        if(result <= 0)break;
+        done += (size_t)result;
+    }
+    close(fd);
+    return done == buffer.size();
+#else
+    std::ifstream file(filepath,std::ios::binary | std::ios::ate);
+    if(!file){
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0,std::ios::beg);
+    buffer.resize((size_t)size);
+    return (bool)file.read(buffer.data(),size);
+#endif
+}
+
+void AsyncFileReader::readWithThreads(const std::vector<std::string>& filepaths,const std::vector<size_t>& indices,const CompletionCallback& onComplete){
+    ThreadPool readers(queueDepth);
+    for(size_t i : indices){
+        //taking the buffer here keeps at most pool size files read ahead of the decoders
+        std::vector<char>* buffer = pool.acquire();
+        readers.enqueue([this,&filepaths,&onComplete,buffer,i](){
+            if(!readWholeFile(filepaths[i],*buffer)){
+                std::cerr << "Failed to read from file " << filepaths[i] << "\n";
+                pool.release(buffer);
+                onComplete(i,nullptr);
+                return;
+            }
+            onComplete(i,buffer);
+        });
+    }
+    readers.wait();
+}
+
+bool evictFromPageCache(const std::string& filepath){
+#if defined(__linux__)
+    int fd = open(filepath.c_str(),O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return false;
+    }
+    //only clean pages are dropped
+    bool ok = posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)filepath;
+    return false;
+#endif
+}
@@ -0,0 +1,65 @@
+#ifndef ASYNCREADER
+#define ASYNCREADER
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+//Fixed set of read buffers handed out and returned, their capacity is kept so reads dont reallocate
+class BufferPool{
+    std::vector<std::unique_ptr<std::vector<char>>> buffers;
+    std::vector<std::vector<char>*> freeBuffers;
+    std::mutex mutex;
+    std::condition_variable bufferReturned;
+    public:
+    BufferPool(u32 count);
+    //blocks until a buffer is free
+    std::vector<char>* acquire();
+    //nullptr if every buffer is out
+    std::vector<char>* tryAcquire();
+    void release(std::vector<char>* buffer);
+    //for a buffer the kernel may still write into: it is leaked on purpose and a new one takes its place
+    void abandon(std::vector<char>* buffer);
+    u32 size() const;
+};
+
+/*
+    Reads whole files with up to queueDepth reads in flight.
+    On Linux the reads go through io_uring, when it is not available (old kernel,
+    seccomp, other platforms) a pool of queueDepth threads does blocking preads instead.
+    Buffers come from the BufferPool, the completion callback owns the buffer and has to
+    give it back to the pool (usually after decoding it on another thread).
+*/
+class AsyncFileReader{
+    public:
+    //buffer is nullptr when the file could not be read, may be called from any thread
+    typedef std::function<void(size_t index,std::vector<char>* buffer)> CompletionCallback;
+
+    AsyncFileReader(BufferPool& _pool,u32 _queueDepth = 32,bool allowIoUring = true);
+    ~AsyncFileReader();
+    //returns once every file has been handed to onComplete
+    void readFiles(const std::vector<std::string>& filepaths,const CompletionCallback& onComplete);
+    bool usingIoUring() const;
+
+    private:
+    struct Ring;
+    BufferPool& pool;
+    u32 queueDepth;
+    std::unique_ptr<Ring> ring;
+
+    void readWithRing(const std::vector<std::string>& filepaths,const CompletionCallback& onComplete);
+    bool cancelInFlight(size_t slotCount,u32 inFlight,const std::function<bool(u32 slotIndex)>& isInFlight);
+    //indices of the files still to read
+    void readWithThreads(const std::vector<std::string>& filepaths,const std::vector<size_t>& indices,const CompletionCallback& onComplete);
+};
+
+//Drops the files from the page cache so the next read comes from the disk, returns false where it isnt supported
+bool evictFromPageCache(const std::string& filepath);
+
+#endif
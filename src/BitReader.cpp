@@ -1,71 +1,45 @@
 #include "BitReader.h"
-#include <iostream>
 
+void StreamBitReader::setInput(const u8* data,size_t size){
+    reader = data;
+    end = data + size;
+}
 
-u32 BitReader:: readBit(){
-    u32 bit = (*reader >> bitOffset) & 1;
-    bitOffset++;
-    if(bitOffset == 8){
-        bitOffset = 0;
+void StreamBitReader::refill(){
+    while(bitCount <= 56 && reader < end){
+        bitBuffer |= (u64)(*reader) << bitCount;
+        bitCount += 8;
         reader++;
         bytesPushed++;
     }
-    return bit;
 }
 
-u32 BitReader::readBits(u8 bitCount){
-    if(bitCount > 32){
-        bitCount = 32;
-    }
-    u32 code = 0;
-    for(u8 i=1;i<=bitCount;i++){
-        code = (code << 1) | readBit();
+bool StreamBitReader::ensureBits(u32 count){
+    if(bitCount < count){
+        refill();
     }
-    
-    return code;
+    return bitCount >= count;
 }
-//Little Endian
-u32 BitReader::readBitsLE(u8 bitCount){
-    if(bitCount > 32){
-        bitCount = 32;
-    }
-    u32 code = 0;
-    for(u8 i=0;i<bitCount;i++){
-        code = code | (readBit() << i);
-    }
-    
-    return code;
+
+u32 StreamBitReader::peekBitsLE(u32 count) const{
+    return (u32)(bitBuffer & ((1ull << count) - 1));
 }
-u32 BitReader::peekBits(u32 bitCount) const{
-    u32 code = 0;
-    for(int i=0;i<bitCount;i++){
-        u32 globalPos = bitOffset + i;
-        u32 byte = reader[globalPos / 8];
-        u32 bit = (byte >> (globalPos % 8)) & 1;
-        code = (code << 1) | bit;
-    }
-    return code;
+
+void StreamBitReader::dropBits(u32 count){
+    bitBuffer >>= count;
+    bitCount -= count;
 }
 
-void BitReader::skipBit(){
-    bitOffset++;
-    if(bitOffset == 8){
-        bitOffset = 0;
-        bytesPushed++;
-        reader++;
-    }
+u32 StreamBitReader::readBitsLE(u32 count){
+    u32 code = peekBitsLE(count);
+    dropBits(count);
+    return code;
 }
 
-void BitReader::skipBits(u32 bitCount){
-    bitOffset += bitCount;
-    u32 bytesToSkip = (bitOffset / 8);
-    bitOffset = bitOffset % 8;
-    reader += bytesToSkip;
-    bytesPushed += bytesToSkip;
+void StreamBitReader::alignToByte(){
+    dropBits(bitCount % 8);
 }
 
-void BitReader::skipCurByte(u32 amount){
-    reader += amount;
-    bytesPushed += amount;
-    bitOffset = 0;
-}
\ No newline at end of file
+size_t StreamBitReader::bytesAvailable() const{
+    return (size_t)(end - reader);
+}
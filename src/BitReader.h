@@ -1,23 +1,32 @@
 #ifndef BITREADER
 #define BITREADER
+#include <cstddef>
 typedef unsigned int u32;
 typedef unsigned char u8;
-class BitReader{
+typedef unsigned long long u64;
+//Bit reader for input that arrives in pieces (Little Endian bit order)
+//bits that were pulled from a slice but not consumed stay in bitBuffer until the next slice
+class StreamBitReader{
     public:
-    u8 bitOffset;
-    u32 bytesPushed;
-    u8* reader;
-    BitReader(u8* _reader)
-    :reader(_reader),bitOffset(0),bytesPushed(0)
+    u64 bitBuffer;
+    u32 bitCount;
+    const u8* reader;
+    const u8* end;
+    u64 bytesPushed;
+    StreamBitReader()
+    :bitBuffer(0),bitCount(0),reader(nullptr),end(nullptr),bytesPushed(0)
     {
 
     };
-    u32 readBit();
-    u32 readBits(u8 bitCount);
-    u32 readBitsLE(u8 bitCount);
-    u32 peekBits(u32 bitCount) const;
-    void skipBit();
-    void skipBits(u32 bitCount);
-    void skipCurByte(u32 amount);
+    void setInput(const u8* data,size_t size);
+    //pulls whole bytes from the input until bitBuffer is full or the input ran out
+    void refill();
+    bool ensureBits(u32 count);
+    u32 peekBitsLE(u32 count) const;
+    void dropBits(u32 count);
+    u32 readBitsLE(u32 count);
+    void alignToByte();
+    //bytes left in the current slice that have not been pulled into bitBuffer
+    size_t bytesAvailable() const;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include "BitWriter.h"
+
+void BitWriter::writeBitsLE(u32 bits,u32 count){
+    bitBuffer |= (u64)(bits & (u32)((1ull << count) - 1)) << bitCount;
+    bitCount += count;
+    while(bitCount >= 8){
+        buffer.push_back((u8)bitBuffer);
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void BitWriter::alignToByte(){
+    if(bitCount > 0){
+        writeBitsLE(0,8 - bitCount);
+    }
+}
+
+void BitWriter::writeBytes(const u8* data,size_t size){
+    buffer.insert(buffer.end(),data,data + size);
+}
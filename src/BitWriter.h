@@ -0,0 +1,30 @@
+#ifndef BITWRITER
+#define BITWRITER
+
+#include <vector>
+#include <cstddef>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+typedef unsigned long long u64;
+
+//Writes bits Little Endian first, the counterpart of StreamBitReader
+class BitWriter{
+    public:
+    std::vector<u8> buffer;
+    u64 bitBuffer;
+    u32 bitCount;
+    BitWriter()
+    :bitBuffer(0),bitCount(0)
+    {
+
+    };
+    //count <= 32
+    void writeBitsLE(u32 bits,u32 count);
+    //pads with zero bits up to the next byte
+    void alignToByte();
+    //only valid when aligned to a byte
+    void writeBytes(const u8* data,size_t size);
+};
+
+#endif
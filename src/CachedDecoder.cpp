@@ -0,0 +1,73 @@
+#include "CachedDecoder.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <filesystem>
+#include <memory>
+
+bool decodeCached(const std::string& filepath,ImageCache& cache,CachedImage& image,const CachedDecodeOptions& options){
+    Parser parser;
+    std::vector<char> buffer;
+    u64 key = 0;
+    u64 check = 0;
+    if(options.keyByContent){
+        if(!parser.readFile(filepath,buffer)){
+            return false;
+        }
+        key = ImageCache::hashBytes((const u8*)buffer.data(),buffer.size());
+        check = buffer.size();
+    }else{
+        key = ImageCache::hashFileIdentity(filepath);
+        std::error_code error;
+        check = std::filesystem::file_size(filepath,error);
+        if(error)key = 0;
+    }
+    if(key != 0 && options.colorOutput != COLOR_AS_IS){
+        key = ImageCache::hashBytes((const u8*)&key,sizeof(key)) + (u64)options.colorOutput;
+    }
+    if(key != 0 && cache.lookup(key,check,image)){
+        return true;
+    }
+    if(buffer.empty() && !parser.readFile(filepath,buffer)){
+        return false;
+    }
+
+    std::shared_ptr<std::vector<u8>> pixels = std::make_shared<std::vector<u8>>();
+    ImageHeader header;
+    if(!decodePixels((const u8*)buffer.data(),buffer.size(),*pixels,header,options.colorOutput,options.maxImageBytes)){
+        std::cerr << "Failed to decode " << filepath << "\n";
+        return false;
+    }
+    image.width = header.width;
+    image.height = header.height;
+    image.channels = header.colorType == 6 ? 4 : 3;
+    image.size = pixels->size();
+    //shares ownership of the vector, points at its data
+    image.pixels = std::shared_ptr<const u8>(pixels,pixels->data());
+    if(key != 0){
+        cache.insert(key,check,image);
+    }
+    return true;
+}
+
+u32 decodeBatch(const std::vector<std::string>& filepaths,ImageCache& cache,const std::function<void(size_t index,const CachedImage& image)>& onImage,u32 threadCount,const CachedDecodeOptions& options){
+    std::vector<u8> ok(filepaths.size(),0);
+    {
+        ThreadPool pool(threadCount);
+        for(size_t i=0;i<filepaths.size();i++){
+            pool.enqueue([&filepaths,&cache,&onImage,&ok,&options,i](){
+                CachedImage image;
+                ok[i] = decodeCached(filepaths[i],cache,image,options) ? 1 : 0;
+                if(ok[i] && onImage){
+                    onImage(i,image);
+                }
+            });
+        }
+        pool.wait();
+    }
+    u32 decoded = 0;
+    for(u8 value : ok){
+        decoded += value;
+    }
+    return decoded;
+}
@@ -0,0 +1,32 @@
+#ifndef CACHEDDECODER
+#define CACHEDDECODER
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "ImageCache.h"
+#include "StreamDecoder.h"
+
+struct CachedDecodeOptions{
+    //hash the file bytes, otherwise the key is path + mtime + size and a hit doesnt touch the file at all
+    bool keyByContent=true;
+    ColorOutput colorOutput=COLOR_AS_IS;
+    //images over this fail to decode instead of taking a worker down
+    u64 maxImageBytes=defaultMaxImageBytes;
+};
+
+/*
+    Decodes through the cache, image.pixels is the defiltered rgb or rgba buffer.
+    Each colorOutput is cached under its own key, the file size is the check value
+    so a colliding key is a miss instead of somebody elses pixels.
+*/
+bool decodeCached(const std::string& filepath,ImageCache& cache,CachedImage& image,const CachedDecodeOptions& options = CachedDecodeOptions());
+
+/*
+    Decodes every file on a thread pool through a shared cache, returns how many succeeded.
+    onImage sees every decoded image on the worker thread, the batch itself holds on to none of them
+    so only the cache budget (and the images being decoded) stay in memory.
+*/
+u32 decodeBatch(const std::vector<std::string>& filepaths,ImageCache& cache,const std::function<void(size_t index,const CachedImage& image)>& onImage = nullptr,u32 threadCount = 0,const CachedDecodeOptions& options = CachedDecodeOptions());
+
+#endif
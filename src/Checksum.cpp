@@ -0,0 +1,60 @@
+#include "Checksum.h"
+#include <algorithm>
+
+static const u32 adlerBase = 65521;
+
+static const u32* crcTable(){
+    static const struct CRCTable{
+        u32 values[256];
+        CRCTable(){
+            for(u32 n=0;n<256;n++){
+                u32 c = n;
+                for(u32 k=0;k<8;k++){
+                    c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                }
+                values[n] = c;
+            }
+        }
+    } table;
+    return table.values;
+}
+
+u32 crc32(u32 crc,const u8* data,size_t size){
+    const u32* table = crcTable();
+    crc = ~crc;
+    for(size_t i=0;i<size;i++){
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+u32 adler32(u32 adler,const u8* data,size_t size){
+    u32 a = adler & 0xffff;
+    u32 b = adler >> 16;
+    //sums are reduced every 5552 bytes so they cant overflow
+    while(size > 0){
+        size_t run = std::min<size_t>(size,5552);
+        for(size_t i=0;i<run;i++){
+            a += data[i];
+            b += a;
+        }
+        a %= adlerBase;
+        b %= adlerBase;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+u32 adler32Combine(u32 adlerA,u32 adlerB,size_t lengthB){
+    u32 remainder = (u32)(lengthB % adlerBase);
+    u32 sum1 = adlerA & 0xffff;
+    u32 sum2 = (u32)(((unsigned long long)remainder * sum1) % adlerBase);
+    sum1 += (adlerB & 0xffff) + adlerBase - 1;
+    sum2 += (adlerA >> 16) + (adlerB >> 16) + adlerBase - remainder;
+    if(sum1 >= adlerBase)sum1 -= adlerBase;
+    if(sum1 >= adlerBase)sum1 -= adlerBase;
+    if(sum2 >= (adlerBase << 1))sum2 -= (adlerBase << 1);
+    if(sum2 >= adlerBase)sum2 -= adlerBase;
+    return (sum2 << 16) | sum1;
+}
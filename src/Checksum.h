@@ -0,0 +1,16 @@
+#ifndef CHECKSUM
+#define CHECKSUM
+
+#include <cstddef>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+//png chunk crc, start with crc = 0
+u32 crc32(u32 crc,const u8* data,size_t size);
+//zlib checksum, start with adler = 1
+u32 adler32(u32 adler,const u8* data,size_t size);
+//adler32 of A followed by B from the checksums of A and B, lengthB is the size of B
+u32 adler32Combine(u32 adlerA,u32 adlerB,size_t lengthB);
+
+#endif
@@ -0,0 +1,281 @@
+#include "ColorProfile.h"
+#include "Inflater.h"
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+static u32 readBigEndian32(const u8* data){
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | (u32)data[3];
+}
+
+static u32 readBigEndian16(const u8* data){
+    return ((u32)data[0] << 8) | (u32)data[1];
+}
+
+bool ColorProfile::readGamma(const u8* data,u32 length){
+    if(length != 4 || readBigEndian32(data) == 0){
+        return false;
+    }
+    gamma = readBigEndian32(data);
+    hasGamma = true;
+    return true;
+}
+
+bool ColorProfile::readSRGB(const u8* data,u32 length){
+    if(length != 1 || data[0] > 3){
+        return false;
+    }
+    renderingIntent = data[0];
+    hasSRGB = true;
+    return true;
+}
+
+bool ColorProfile::readChromaticities(const u8* data,u32 length){
+    if(length != 32){
+        return false;
+    }
+    for(u32 i=0;i<8;i++){
+        chromaticities[i] = readBigEndian32(data + i*4);
+    }
+    hasChromaticities = true;
+    return true;
+}
+
+//curv or para tag, only curves that are a single gamma or the sRGB curve count
+static bool readTransferTag(const u8* tag,u32 size,TransferKind& kind,double& exponent){
+    if(size < 12){
+        return false;
+    }
+    if(std::memcmp(tag,"curv",4) == 0){
+        u32 count = readBigEndian32(tag + 8);
+        if(count == 0){
+            kind = TRANSFER_GAMMA;
+            exponent = 1.0;
+            return true;
+        }
+        if(count == 1 && size >= 14){
+            //u8Fixed8Number
+            kind = TRANSFER_GAMMA;
+            exponent = readBigEndian16(tag + 12)/256.0;
+            return exponent > 0;
+        }
+        return false;
+    }
+    if(std::memcmp(tag,"para",4) == 0){
+        u32 function = readBigEndian16(tag + 8);
+        u32 parameterCount = function == 0 ? 1 : (function == 1 ? 3 : (function == 2 ? 4 : (function == 3 ? 5 : 7)));
+        if(function > 4 || size < 12 + parameterCount*4){
+            return false;
+        }
+        double parameters[7];
+        for(u32 i=0;i<parameterCount;i++){
+            //s15Fixed16Number
+            parameters[i] = (int)readBigEndian32(tag + 12 + i*4)/65536.0;
+        }
+        if(function == 0){
+            kind = TRANSFER_GAMMA;
+            exponent = parameters[0];
+            return exponent > 0;
+        }
+        //Y = (aX+b)^g above d, cX below, with the sRGB numbers
+        const double srgb[5] = {2.4,1.0/1.055,0.055/1.055,1.0/12.92,0.04045};
+        if(function == 3){
+            for(u32 i=0;i<5;i++){
+                if(std::fabs(parameters[i] - srgb[i]) > 0.001){
+                    return false;
+                }
+            }
+            kind = TRANSFER_SRGB;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ColorProfile::readICC(const u8* data,u32 length){
+    //name (1-79 bytes), null, compression method, zlib stream
+    const u8* nameEnd = (const u8*)std::memchr(data,0,std::min<u32>(length,80));
+    if(!nameEnd || nameEnd == data || (u32)(nameEnd - data) + 2 > length || nameEnd[1] != 0){
+        return false;
+    }
+    iccName.assign((const char*)data,nameEnd - data);
+    hasICC = true;
+
+    //real profiles are a few KiB to a few hundred KiB, a small chunk could otherwise inflate to gigabytes
+    const size_t maxProfileSize = (size_t)4 << 20;
+    std::vector<u8> icc;
+    bool tooLarge = false;
+    Inflater inflater([&icc,&tooLarge,maxProfileSize](const u8* out,size_t size){
+        if(tooLarge || size > maxProfileSize - icc.size()){
+            tooLarge = true;
+            return;
+        }
+        icc.insert(icc.end(),out,out + size);
+    });
+    //fed in slices so inflating stops soon after the limit is hit (one slice inflates to at most ~4MiB)
+    const u8* stream = nameEnd + 2;
+    const u8* end = data + length;
+    const size_t sliceSize = 4096;
+    Inflater::Status status = Inflater::INFLATE_NEED_INPUT;
+    while(stream < end && status == Inflater::INFLATE_NEED_INPUT && !tooLarge){
+        size_t count = std::min<size_t>(sliceSize,end - stream);
+        status = inflater.feed(stream,count);
+        stream += count;
+    }
+    if(tooLarge){
+        std::cerr << "The ICC profile " << iccName << " inflates to more than " << maxProfileSize << " bytes\n";
+        return false;
+    }
+    if(status != Inflater::INFLATE_DONE){
+        std::cerr << "Failed to inflate the ICC profile " << iccName << "\n";
+        return false;
+    }
+    if(icc.size() < 132){
+        return false;
+    }
+    u32 tagCount = readBigEndian32(icc.data() + 128);
+    if(tagCount > (icc.size() - 132)/12){
+        return false;
+    }
+    //every color channel has to use the same curve
+    bool found = false;
+    for(u32 i=0;i<tagCount;i++){
+        const u8* entry = icc.data() + 132 + i*12;
+        bool colorTRC = std::memcmp(entry,"rTRC",4) == 0 || std::memcmp(entry,"gTRC",4) == 0 ||
+                        std::memcmp(entry,"bTRC",4) == 0 || std::memcmp(entry,"kTRC",4) == 0;
+        if(!colorTRC){
+            continue;
+        }
+        u32 offset = readBigEndian32(entry + 4);
+        u32 size = readBigEndian32(entry + 8);
+        if(offset > icc.size() || size > icc.size() - offset){
+            return false;
+        }
+        TransferKind kind = TRANSFER_SRGB;
+        double exponent = 1.0;
+        if(!readTransferTag(icc.data() + offset,size,kind,exponent)){
+            iccTransferFound = false;
+            return true;
+        }
+        if(found && (kind != iccTransfer || std::fabs(exponent - iccExponent) > 1e-6)){
+            iccTransferFound = false;
+            return true;
+        }
+        iccTransfer = kind;
+        iccExponent = exponent;
+        found = true;
+    }
+    iccTransferFound = found;
+    return true;
+}
+
+void ColorProfile::getTransfer(TransferKind& kind,double& exponent) const{
+    kind = TRANSFER_SRGB;
+    exponent = 1.0;
+    if(hasSRGB){
+        return;
+    }
+    if(hasICC && iccTransferFound){
+        kind = iccTransfer;
+        exponent = iccExponent;
+        return;
+    }
+    if(hasGamma){
+        //the file gamma is the encoding exponent
+        kind = TRANSFER_GAMMA;
+        exponent = 100000.0/gamma;
+    }
+}
+
+static double srgbToLinear(double value){
+    return value <= 0.04045 ? value/12.92 : std::pow((value + 0.055)/1.055,2.4);
+}
+
+static double linearToSRGB(double value){
+    return value <= 0.0031308 ? value*12.92 : 1.055*std::pow(value,1.0/2.4) - 0.055;
+}
+
+static double convertSample(double value,TransferKind kind,double exponent,ColorOutput output){
+    double linear = (kind == TRANSFER_SRGB) ? srgbToLinear(value) : std::pow(value,exponent);
+    double result = (output == COLOR_LINEAR) ? linear : linearToSRGB(linear);
+    return std::min(1.0,std::max(0.0,result));
+}
+
+std::shared_ptr<const ColorLUT> getColorLUT(const ColorProfile& profile,ColorOutput output){
+    if(output == COLOR_AS_IS){
+        return nullptr;
+    }
+    TransferKind kind;
+    double exponent;
+    profile.getTransfer(kind,exponent);
+    if((output == COLOR_SRGB && kind == TRANSFER_SRGB) || (output == COLOR_LINEAR && kind == TRANSFER_GAMMA && exponent == 1.0)){
+        return nullptr;
+    }
+
+    //a handful of distinct curves per process, they are never evicted
+    typedef std::tuple<int,long long,int> Key;
+    static std::map<Key,std::shared_ptr<const ColorLUT>> tables;
+    static std::mutex mutex;
+    Key key((int)kind,kind == TRANSFER_GAMMA ? std::llround(exponent*1e9) : 0,(int)output);
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = tables.find(key);
+    if(it != tables.end()){
+        return it->second;
+    }
+    std::shared_ptr<ColorLUT> lut(new ColorLUT());
+    lut->kind = kind;
+    lut->exponent = exponent;
+    lut->output = output;
+    for(u32 i=0;i<256;i++){
+        lut->lut8[i] = (u8)std::lround(convertSample(i/255.0,kind,exponent,output)*255.0);
+    }
+    tables[key] = lut;
+    return lut;
+}
+
+const u16* ColorLUT::table16() const{
+    //outside getColorLUT's lock, only the threads that want this table wait for it
+    std::call_once(lut16Built,[this](){
+        lut16.resize(65536);
+        for(u32 i=0;i<65536;i++){
+            lut16[i] = (u16)std::lround(convertSample(i/65535.0,kind,exponent,output)*65535.0);
+        }
+    });
+    return lut16.data();
+}
+
+void applyColorLUT(const ColorLUT& lut,const u8* in,u8* out,size_t width,u32 pixelBytes){
+    const u8* table = lut.lut8;
+    if(pixelBytes == 3){
+        size_t count = width*3;
+        for(size_t i=0;i<count;i++){
+            out[i] = table[in[i]];
+        }
+        return;
+    }
+    for(size_t x=0;x<width;x++){
+        out[x*4+0] = table[in[x*4+0]];
+        out[x*4+1] = table[in[x*4+1]];
+        out[x*4+2] = table[in[x*4+2]];
+        out[x*4+3] = in[x*4+3];
+    }
+}
+
+void applyColorLUT16(const ColorLUT& lut,const u8* in,u8* out,size_t width,u32 channels){
+    const u16* table = lut.table16();
+    //gray and alpha or RGBA, the last channel is alpha
+    u32 alphaChannel = (channels == 2 || channels == 4) ? channels - 1 : channels;
+    for(size_t x=0;x<width;x++){
+        for(u32 c=0;c<channels;c++){
+            size_t offset = (x*channels + c)*2;
+            u32 sample = readBigEndian16(in + offset);
+            u32 value = (c == alphaChannel) ? sample : table[sample];
+            out[offset] = (u8)(value >> 8);
+            out[offset+1] = (u8)value;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef COLORPROFILE
+#define COLORPROFILE
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+
+typedef unsigned int u32;
+typedef unsigned short u16;
+typedef unsigned char u8;
+
+enum ColorOutput{
+    COLOR_AS_IS=0,  //samples are passed through
+    COLOR_LINEAR,   //linear light
+    COLOR_SRGB      //sRGB encoded
+};
+
+enum TransferKind{
+    TRANSFER_SRGB=0,    //the sRGB curve
+    TRANSFER_GAMMA      //linear = sample^exponent
+};
+
+/*
+    Color chunks of a png. sRGB and iCCP take precedence over gAMA as the spec asks,
+    untagged images are treated as sRGB. cHRM is only stored, there is no gamut mapping.
+*/
+struct ColorProfile{
+    bool hasGamma=false;
+    u32 gamma=0;                //gAMA: file gamma * 100000 (45455 = 1/2.2)
+    bool hasSRGB=false;
+    u8 renderingIntent=0;
+    bool hasChromaticities=false;
+    u32 chromaticities[8]={0};  //cHRM: white x,y red x,y green x,y blue x,y * 100000
+    bool hasICC=false;
+    std::string iccName;
+    bool iccTransferFound=false;    //the profile's TRC is a plain gamma or the sRGB curve
+    TransferKind iccTransfer=TRANSFER_SRGB;
+    double iccExponent=1.0;
+
+    bool readGamma(const u8* data,u32 length);
+    bool readSRGB(const u8* data,u32 length);
+    bool readChromaticities(const u8* data,u32 length);
+    //inflates the embedded profile and pulls the transfer curve out of its rTRC/gTRC/bTRC (or kTRC) tags
+    bool readICC(const u8* data,u32 length);
+    //curve that takes the stored samples to linear light
+    void getTransfer(TransferKind& kind,double& exponent) const;
+};
+
+//Lookup tables from stored samples to the output encoding
+struct ColorLUT{
+    u8 lut8[256];
+    TransferKind kind=TRANSFER_SRGB;
+    double exponent=1.0;
+    ColorOutput output=COLOR_AS_IS;
+
+    //65536 entries for 16 bit samples, built on the first call since 8 bit decodes never need it
+    const u16* table16() const;
+
+    private:
+    mutable std::once_flag lut16Built;
+    mutable std::vector<u16> lut16;
+};
+
+//Tables for the profile's curve and the output, built once per distinct curve and output and shared.
+//nullptr when the samples are already in the output encoding
+std::shared_ptr<const ColorLUT> getColorLUT(const ColorProfile& profile,ColorOutput output);
+
+//8 bit rows, the alpha of 4 byte pixels is copied as is. in and out can be the same row
+void applyColorLUT(const ColorLUT& lut,const u8* in,u8* out,size_t width,u32 pixelBytes);
+//16 bit big endian rows (as stored in a png), 1-4 channels per pixel, the alpha of 2 and 4 channel pixels is copied as is.
+//The decoders only take 8 bit images so far, nothing but the tests calls it yet
+void applyColorLUT16(const ColorLUT& lut,const u8* in,u8* out,size_t width,u32 channels);
+
+#endif
@@ -0,0 +1,74 @@
+#include "Defilter.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+u32 paethPredictor(u8 a,u8 b,u8 c){
+    u32 pr = 0;
+    int p = a + b - c;
+    u32 pa = abs(p - a);
+    u32 pb = abs(p - b);
+    u32 pc = abs(p - c);
+    if(pa <= pb && pa <= pc)pr = a;
+    else if(pb <= pc)pr = b;
+    else pr = c;
+
+    return pr;
+}
+
+/*
+       c       b
+    |R|G|B| |R|G|B|
+       a       x
+    |R|G|B| |R|G|B| -> Current Pixel
+
+    filtering types
+
+    defiltering:
+    0 = none    : reconstructed x[channel] = filtered x[channel]
+    1 = sub     : reconstructed x[channel] = filtered x[channel] + filtered a[channel]
+    2 = up      : reconstructed x[channel] = filtered x[channel] + filtered b[channel]
+    3 = average : reconstructed x[channel] = filtered x[channel] + floor((filtered a[channel] + filtered b[channel]) / 2)
+    4 = paeth   : reconstructed x[channel] = filtered x[channel] + paeth(a,b,c)
+*/
+//Reconstructs one scanline into out, prevRow is the reconstructed scanline above it (nullptr for the first scanline).
+//The filter type is picked once per row, the first pixel has no left neighbour and is done apart from the rest
+void defilterScanline(const u8* filtered,u8 filterType,const u8* prevRow,u8* out,size_t rowBytes,u32 pixelBytes){
+    size_t head = std::min<size_t>(pixelBytes,rowBytes);
+    //unknown types are refused by the callers, they are copied like none
+    if(filterType == 0 || filterType > 4 || (filterType == 2 && !prevRow)){
+        std::memcpy(out,filtered,rowBytes);
+    }else if(filterType == 1 || (filterType == 4 && !prevRow)){
+        //without a row above paeth always picks a
+        std::memcpy(out,filtered,head);
+        for(size_t i=head;i<rowBytes;i++){
+            out[i] = filtered[i] + out[i-pixelBytes];
+        }
+    }else if(filterType == 2){
+        for(size_t i=0;i<rowBytes;i++){
+            out[i] = filtered[i] + prevRow[i];
+        }
+    }else if(filterType == 3){
+        if(!prevRow){
+            std::memcpy(out,filtered,head);
+            for(size_t i=head;i<rowBytes;i++){
+                out[i] = filtered[i] + (out[i-pixelBytes] >> 1);
+            }
+            return;
+        }
+        for(size_t i=0;i<head;i++){
+            out[i] = filtered[i] + (prevRow[i] >> 1);
+        }
+        for(size_t i=head;i<rowBytes;i++){
+            out[i] = filtered[i] + ((out[i-pixelBytes] + prevRow[i]) >> 1);
+        }
+    }else{
+        //a and c are 0 for the first pixel, paeth picks b
+        for(size_t i=0;i<head;i++){
+            out[i] = filtered[i] + prevRow[i];
+        }
+        for(size_t i=head;i<rowBytes;i++){
+            out[i] = filtered[i] + paethPredictor(out[i-pixelBytes],prevRow[i],prevRow[i-pixelBytes]);
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef DEFILTER
+#define DEFILTER
+
+#include <cstddef>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+u32 paethPredictor(u8 a,u8 b,u8 c);
+//Reconstructs one scanline into out, prevRow is the reconstructed scanline above it (nullptr for the first scanline)
+void defilterScanline(const u8* filtered,u8 filterType,const u8* prevRow,u8* out,size_t rowBytes,u32 pixelBytes);
+
+#endif
@@ -0,0 +1,243 @@
+#include "Deflater.h"
+#include "Checksum.h"
+#include <algorithm>
+#include <cstring>
+
+static const u32 windowSize = 32768;
+static const u32 minMatch = 3;
+static const u32 maxMatch = 258;
+static const u32 hashBits = 15;
+//input bytes tokenized per block
+static const size_t blockSize = 1 << 16;
+
+static const u32 lengthBase[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258
+};
+static const u32 lengthExtraBits[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+};
+static const u32 distanceBase[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577
+};
+static const u32 distanceExtraBits[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
+};
+
+struct Token{
+    u32 value;      //literal byte or match length
+    u32 distance;   //0 for literals
+};
+
+//Fixed huffman codes from the rfc, already bit reversed for BitWriter::writeBitsLE
+struct FixedCodes{
+    u32 literalCode[288];
+    u32 literalLength[288];
+    u32 distanceCode[30];
+    u8 lengthSymbol[maxMatch+1];
+
+    static u32 reverse(u32 code,u32 length){
+        u32 reversed = 0;
+        for(u32 i=0;i<length;i++){
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return reversed;
+    }
+    FixedCodes(){
+        for(u32 i=0;i<288;i++){
+            u32 code = 0;
+            u32 length = 0;
+            if(i < 144){
+                code = 0x30 + i;
+                length = 8;
+            }else if(i < 256){
+                code = 0x190 + (i - 144);
+                length = 9;
+            }else if(i < 280){
+                code = i - 256;
+                length = 7;
+            }else{
+                code = 0xC0 + (i - 280);
+                length = 8;
+            }
+            literalCode[i] = reverse(code,length);
+            literalLength[i] = length;
+        }
+        for(u32 i=0;i<30;i++){
+            distanceCode[i] = reverse(i,5);
+        }
+        u32 symbol = 0;
+        for(u32 length=minMatch;length<=maxMatch;length++){
+            while(symbol < 28 && length >= lengthBase[symbol+1])symbol++;
+            lengthSymbol[length] = (u8)symbol;
+        }
+    }
+};
+
+static const FixedCodes& fixedCodes(){
+    static const FixedCodes codes;
+    return codes;
+}
+
+static u32 distanceSymbol(u32 distance){
+    u32 symbol = 29;
+    while(distanceBase[symbol] > distance)symbol--;
+    return symbol;
+}
+
+static inline u32 hash3(const u8* data){
+    u32 value = ((u32)data[0] << 16) | ((u32)data[1] << 8) | data[2];
+    return (value * 2654435761u) >> (32 - hashBits);
+}
+
+//Hash chains over the whole input, positions older than the window are ignored
+class MatchFinder{
+    const u8* data;
+    size_t size;
+    //positions are 64 bit, a single band can be larger than 2GiB
+    std::vector<long long> head;
+    std::vector<long long> prev;
+    const DeflateOptions& options;
+    public:
+    MatchFinder(const u8* _data,size_t _size,const DeflateOptions& _options)
+    :data(_data),size(_size),head((size_t)1 << hashBits,-1),prev(windowSize,-1),options(_options)
+    {
+
+    };
+    void insert(size_t pos){
+        if(pos + minMatch > size)return;
+        u32 h = hash3(data + pos);
+        prev[pos & (windowSize-1)] = head[h];
+        head[h] = (long long)pos;
+    }
+    //longest match for pos, length 0 if there is none
+    u32 find(size_t pos,u32& distance) const{
+        if(pos + minMatch > size)return 0;
+        u32 maxLength = (u32)std::min<size_t>(maxMatch,size - pos);
+        u32 bestLength = 0;
+        long long candidate = head[hash3(data + pos)];
+        u32 chain = options.maxChainLength;
+        while(candidate >= 0 && chain-- > 0){
+            size_t candidateDistance = pos - (size_t)candidate;
+            if(candidateDistance > windowSize)break;
+            const u8* a = data + candidate;
+            const u8* b = data + pos;
+            //cheap reject before the full compare
+            if(a[bestLength] == b[bestLength] && a[0] == b[0]){
+                u32 length = 0;
+                while(length < maxLength && a[length] == b[length])length++;
+                if(length > bestLength){
+                    bestLength = length;
+                    distance = (u32)candidateDistance;
+                    if(length >= options.niceLength || length == maxLength)break;
+                }
+            }
+            long long next = prev[candidate & (windowSize-1)];
+            //the slot was reused by a newer position, the chain ends here
+            if(next >= candidate)break;
+            candidate = next;
+        }
+        return bestLength >= minMatch ? bestLength : 0;
+    }
+};
+
+static void writeStoredBlocks(const u8* data,size_t size,bool lastBlock,BitWriter& writer){
+    do{
+        u32 length = (u32)std::min<size_t>(size,0xffff);
+        bool last = lastBlock && length == size;
+        writer.writeBitsLE(last ? 1 : 0,1);
+        writer.writeBitsLE(0,2);
+        writer.alignToByte();
+        writer.writeBitsLE(length,16);
+        writer.writeBitsLE(length ^ 0xffff,16);
+        writer.writeBytes(data,length);
+        data += length;
+        size -= length;
+    }while(size > 0);
+}
+
+static void writeFixedBlock(const std::vector<Token>& tokens,bool lastBlock,BitWriter& writer){
+    const FixedCodes& codes = fixedCodes();
+    writer.writeBitsLE(lastBlock ? 1 : 0,1);
+    writer.writeBitsLE(1,2);
+    for(const Token& token : tokens){
+        if(token.distance == 0){
+            writer.writeBitsLE(codes.literalCode[token.value],codes.literalLength[token.value]);
+            continue;
+        }
+        u32 lengthSymbol = codes.lengthSymbol[token.value];
+        writer.writeBitsLE(codes.literalCode[257+lengthSymbol],codes.literalLength[257+lengthSymbol]);
+        writer.writeBitsLE(token.value - lengthBase[lengthSymbol],lengthExtraBits[lengthSymbol]);
+        u32 symbol = distanceSymbol(token.distance);
+        writer.writeBitsLE(codes.distanceCode[symbol],5);
+        writer.writeBitsLE(token.distance - distanceBase[symbol],distanceExtraBits[symbol]);
+    }
+    writer.writeBitsLE(codes.literalCode[256],codes.literalLength[256]);
+}
+
+void Deflater::compress(const u8* data,size_t size,bool lastBlock,BitWriter& writer,const DeflateOptions& options){
+    const FixedCodes& codes = fixedCodes();
+    MatchFinder matchFinder(data,size,options);
+    std::vector<Token> tokens;
+    tokens.reserve(blockSize);
+
+    size_t pos = 0;
+    if(size == 0 && lastBlock){
+        //an empty final block
+        writeFixedBlock(tokens,true,writer);
+        return;
+    }
+    while(pos < size){
+        size_t blockStart = pos;
+        size_t blockEnd = std::min(size,pos + blockSize);
+        tokens.clear();
+        //header + end of block
+        u64 fixedBits = 3 + 7;
+        while(pos < blockEnd){
+            u32 distance = 0;
+            u32 length = matchFinder.find(pos,distance);
+            if(length == 0){
+                tokens.push_back({data[pos],0});
+                fixedBits += codes.literalLength[data[pos]];
+                matchFinder.insert(pos);
+                pos++;
+                continue;
+            }
+            tokens.push_back({length,distance});
+            u32 lengthSymbol = codes.lengthSymbol[length];
+            fixedBits += codes.literalLength[257+lengthSymbol] + lengthExtraBits[lengthSymbol] + 5 + distanceExtraBits[distanceSymbol(distance)];
+            for(u32 i=0;i<length;i++){
+                matchFinder.insert(pos+i);
+            }
+            pos += length;
+        }
+
+        bool last = lastBlock && pos == size;
+        size_t blockBytes = pos - blockStart;
+        //3 bit header, up to 7 bits of padding and LEN/NLEN per 65535 bytes
+        u64 storedBits = (u64)blockBytes*8 + (u64)((blockBytes + 0xfffe)/0xffff)*(3 + 7 + 32);
+        if(storedBits < fixedBits){
+            writeStoredBlocks(data + blockStart,blockBytes,last,writer);
+        }else{
+            writeFixedBlock(tokens,last,writer);
+        }
+    }
+
+    if(!lastBlock){
+        //full flush: empty stored block, the stream is byte aligned afterwards
+        writeStoredBlocks(data,0,false,writer);
+    }
+}
+
+std::vector<u8> Deflater::compressZlib(const u8* data,size_t size,const DeflateOptions& options){
+    BitWriter writer;
+    //CMF: deflate with a 32KiB window, FLG: default level, no dictionary
+    writer.writeBitsLE(0x78,8);
+    writer.writeBitsLE(0x9C,8);
+    compress(data,size,true,writer,options);
+    writer.alignToByte();
+    u32 adler = adler32(1,data,size);
+    for(int shift=24;shift>=0;shift-=8){
+        writer.writeBitsLE((adler >> shift) & 0xff,8);
+    }
+    return writer.buffer;
+}
@@ -0,0 +1,28 @@
+#ifndef DEFLATER
+#define DEFLATER
+
+#include <vector>
+#include "BitWriter.h"
+
+struct DeflateOptions{
+    u32 maxChainLength=64;  //hash chain entries tried per position, more = smaller output and slower
+    u32 niceLength=128;     //stop searching once a match is at least this long
+};
+
+/*
+    Deflate compressor, LZ77 with a hash chain matcher and fixed huffman blocks
+    (blocks that dont compress are written as stored blocks).
+*/
+class Deflater{
+    public:
+    /*
+        Compresses size bytes as deflate blocks into writer, matches never reach before data.
+        lastBlock marks the final block, otherwise the blocks end with an empty stored block
+        (a full flush) so the output is byte aligned and can be followed by another independent part.
+    */
+    static void compress(const u8* data,size_t size,bool lastBlock,BitWriter& writer,const DeflateOptions& options = DeflateOptions());
+    //Complete zlib stream (header + deflate blocks + adler32)
+    static std::vector<u8> compressZlib(const u8* data,size_t size,const DeflateOptions& options = DeflateOptions());
+};
+
+#endif
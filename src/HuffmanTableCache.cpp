@@ -0,0 +1,140 @@
+#include "HuffmanTableCache.h"
+#include "Timer.h"
+#include <algorithm>
+#include <memory>
+
+//capacity is split over the shards, rounded up so a small capacity still caches something
+static size_t perShard(size_t capacity,u32 shardCount){
+    return (capacity + shardCount - 1)/shardCount;
+}
+
+HuffmanTableCache::HuffmanTableCache(size_t _capacity)
+:shardCapacity(perShard(_capacity,shardCount)),timing(false)
+{
+
+}
+
+HuffmanTableCache& HuffmanTableCache::shared(){
+    static HuffmanTableCache cache;
+    return cache;
+}
+
+//FNV-1a over the lengths, hLit is mixed in so the literal/distance split is part of the key
+static u64 hashCodeLengths(const u8* lengths,size_t count,u32 hLit){
+    u64 hash = 14695981039346656037ull ^ hLit;
+    for(size_t i=0;i<count;i++){
+        hash ^= lengths[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::shared_ptr<const HuffmanTables> HuffmanTableCache::get(const u32* codeLengths,u32 hLit,u32 hDist){
+    //code lengths are at most 15, so the key is built from bytes
+    u8 lengths[286+32];
+    u32 count = hLit + hDist;
+    if(count > sizeof(lengths)){
+        return nullptr;
+    }
+    for(u32 i=0;i<count;i++){
+        lengths[i] = (u8)codeLengths[i];
+    }
+    return get(hashCodeLengths(lengths,count,hLit),codeLengths,hLit,hDist);
+}
+
+std::shared_ptr<const HuffmanTables> HuffmanTableCache::get(u64 key,const u32* codeLengths,u32 hLit,u32 hDist){
+    u8 lengths[286+32];
+    u32 count = hLit + hDist;
+    if(count > sizeof(lengths)){
+        return nullptr;
+    }
+    for(u32 i=0;i<count;i++){
+        lengths[i] = (u8)codeLengths[i];
+    }
+    //the top bits pick the shard, the low bits spread the keys inside the shard's map
+    Shard& shard = shards[(key >> 60) % shardCount];
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if(it != shard.entries.end()){
+            const HuffmanTables& tables = *it->second.tables;
+            if(tables.hLit == hLit && tables.codeLengths.size() == count &&
+               std::equal(tables.codeLengths.begin(),tables.codeLengths.end(),lengths)){
+                shard.lru.splice(shard.lru.begin(),shard.lru,it->second.lruPosition);
+                shard.stats.hits++;
+                shard.stats.savedMilliseconds += shard.stats.buildMilliseconds/std::max<u64>(1,shard.stats.misses);
+                return it->second.tables;
+            }
+            shard.stats.collisions++;
+        }
+    }
+
+    //built outside the lock, two threads missing on the same header both build it
+    bool timed = timing.load(std::memory_order_relaxed);
+    std::unique_ptr<Timer> timer(timed ? new Timer() : nullptr);
+    std::shared_ptr<HuffmanTables> tables(new HuffmanTables());
+    tables->hLit = hLit;
+    tables->codeLengths.assign(lengths,lengths + count);
+    if(!tables->literalTree.buildFromCodeLengths(codeLengths,hLit) ||
+       !tables->distanceTree.buildFromCodeLengths(codeLengths + hLit,hDist)){
+        return nullptr;
+    }
+    if(timer){
+        timer->stop();
+    }
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.stats.misses++;
+    if(timer){
+        shard.stats.buildMilliseconds += timer->dtms;
+    }
+    size_t limit = shardCapacity.load(std::memory_order_relaxed);
+    if(limit == 0){
+        return tables;
+    }
+    auto it = shard.entries.find(key);
+    if(it != shard.entries.end()){
+        //collision or another thread got there first, the newest tables win
+        shard.lru.erase(it->second.lruPosition);
+        shard.entries.erase(it);
+    }
+    shard.lru.push_front(key);
+    shard.entries[key] = Entry{tables,shard.lru.begin()};
+    trim(shard,limit);
+    return tables;
+}
+
+void HuffmanTableCache::trim(Shard& shard,size_t limit){
+    while(shard.entries.size() > limit){
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+        shard.stats.evictions++;
+    }
+}
+
+HuffmanCacheStats HuffmanTableCache::getStats() const{
+    HuffmanCacheStats total;
+    for(const Shard& shard : shards){
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.evictions += shard.stats.evictions;
+        total.collisions += shard.stats.collisions;
+        total.buildMilliseconds += shard.stats.buildMilliseconds;
+        total.savedMilliseconds += shard.stats.savedMilliseconds;
+    }
+    return total;
+}
+
+void HuffmanTableCache::setCapacity(size_t _capacity){
+    size_t limit = perShard(_capacity,shardCount);
+    shardCapacity = limit;
+    for(Shard& shard : shards){
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        trim(shard,limit);
+    }
+}
+
+void HuffmanTableCache::setTiming(bool enabled){
+    timing = enabled;
+}
@@ -0,0 +1,78 @@
+#ifndef HUFFMANTABLECACHE
+#define HUFFMANTABLECACHE
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include "HuffmanTree.h"
+
+typedef unsigned long long u64;
+
+//Decode trees of one dynamic block header
+struct HuffmanTables{
+    std::vector<u8> codeLengths;    //literal/length then distance code lengths, compared on lookup so a hash collision cant return the wrong trees
+    u32 hLit=0;
+    HuffmanTree literalTree;
+    HuffmanTree distanceTree;
+};
+
+struct HuffmanCacheStats{
+    u64 hits=0;
+    u64 misses=0;
+    u64 evictions=0;
+    u64 collisions=0;               //lookups whose key was held by different code lengths
+    double buildMilliseconds=0;     //spent building trees on misses, only measured with setTiming(true)
+    double savedMilliseconds=0;     //hits times the average build time
+    double hitRate() const{
+        return (hits + misses) ? (double)hits/(hits + misses) : 0;
+    }
+};
+
+/*
+    LRU of built literal/length and distance trees keyed by a hash of the code lengths
+    of a dynamic block header. Encoders often repeat the same header across blocks and
+    across images from the same source, a hit skips building both trees and their
+    lookup tables.
+    The keys are spread over shards with their own lock and LRU so decode threads
+    rarely wait on each other, the capacity is split evenly between them.
+    All public functions can be called from several threads, the returned tables stay
+    valid while they are held even if they are evicted.
+*/
+class HuffmanTableCache{
+    struct Entry{
+        std::shared_ptr<const HuffmanTables> tables;
+        std::list<u64>::iterator lruPosition;
+    };
+    struct Shard{
+        std::list<u64> lru; //front is the most recently used
+        std::unordered_map<u64,Entry> entries;
+        HuffmanCacheStats stats;
+        mutable std::mutex mutex;
+    };
+    static const u32 shardCount = 16;
+    Shard shards[shardCount];
+    std::atomic<size_t> shardCapacity;
+    std::atomic<bool> timing;
+
+    static void trim(Shard& shard,size_t limit);
+    public:
+    HuffmanTableCache(size_t _capacity = 256);
+    //Trees for hLit literal/length and hDist distance code lengths, nullptr if the lengths dont form valid codes
+    std::shared_ptr<const HuffmanTables> get(const u32* codeLengths,u32 hLit,u32 hDist);
+    //Same with the caller's key, the lengths are still compared so a shared key only costs a rebuild
+    std::shared_ptr<const HuffmanTables> get(u64 key,const u32* codeLengths,u32 hLit,u32 hDist);
+    //Counters of every shard added up
+    HuffmanCacheStats getStats() const;
+    //0 turns the cache off, every header is built
+    void setCapacity(size_t _capacity);
+    //Times every tree build for buildMilliseconds/savedMilliseconds, off by default
+    void setTiming(bool enabled);
+
+    //Used by every Inflater
+    static HuffmanTableCache& shared();
+};
+
+#endif
@@ -2,16 +2,18 @@
 #define HUFFMANTREE
 
 #include <vector>
-#include <unordered_map>
-#include "BitReader.h"
 
 typedef unsigned char u8;
 typedef unsigned int u32;
 
-struct BitRange{
-    u32 bitCount;
-    u32 min;
-};
+//decodeLE() results that are not symbols
+const u32 HUFFMAN_INVALID_CODE = 0xffffffff;
+const u32 HUFFMAN_NEED_BITS = 0xfffffffe;
+
+typedef unsigned short u16;
+
+//codes up to this long are decoded with a single table lookup
+const u32 HUFFMAN_TABLE_BITS = 9;
 
 struct HuffmanTree{
     u8 maxBit=0;
@@ -20,13 +22,15 @@ struct HuffmanTree{
     std::vector<u32> firstCode;
     std::vector<u32> firstSymbol;
     std::vector<u32> symbols;
-    std::unordered_map<u32,BitRange> symbolRangeMap;
+    //indexed by the next tableBits stream bits: symbol | code length << 9, 0 for codes longer than tableBits
+    u32 tableBits=0;
+    std::vector<u16> table;
 
-    void setCodeLengths(u32 symbols[],u32 cLen[],u32 cLenSize);
-    void initializeStaticDeflateTree();
-    void setMaxBit(u8 maxCount);
-    bool getKMI(u32 cLen[],u32 cLenSize);
-    u32 decode(const BitReader& br,u32& bitlength);
+    //Canonical tree where symbol i has code length cLen[i], returns false if the lengths are over subscribed
+    bool buildFromCodeLengths(const u32 cLen[],u32 cLenSize);
+    //Decodes from Little Endian stream bits, HUFFMAN_NEED_BITS when availableBits are not enough for the code.
+    //Short codes come straight from the table, longer ones are matched a bit at a time
+    u32 decodeLE(u32 bits,u32 availableBits,u32& bitlength) const;
 };
 
 #endif
\ No newline at end of file
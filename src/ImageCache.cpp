@@ -0,0 +1,403 @@
+#include "ImageCache.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Spill file: magic(4) width(4) height(4) channels(4) check(8) then width*height*channels bytes
+static const char spillMagic[4] = {'P','L','C','2'};
+static const size_t spillHeaderSize = 24;
+
+ImageCache::ImageCache(size_t _byteBudget,const std::string& _spillDirectory,u64 _spillBudget)
+:byteBudget(_byteBudget),spillDirectory(_spillDirectory),spillBudget(_spillBudget)
+{
+    if(!spillDirectory.empty()){
+        std::error_code error;
+        std::filesystem::create_directories(spillDirectory,error);
+        if(error){
+            std::cerr << "Failed to create cache spill directory " << spillDirectory << "\n";
+            spillDirectory.clear();
+            return;
+        }
+        scanSpillDirectory();
+    }
+}
+
+//Registers the blobs of earlier runs, oldest first so they are the first to go, and drops half written ones
+void ImageCache::scanSpillDirectory(){
+    std::vector<std::pair<std::filesystem::file_time_type,std::pair<u64,u64>>> blobs;
+    std::error_code error;
+    for(const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(spillDirectory,error)){
+        std::string name = file.path().filename().string();
+        if(file.path().extension() == ".tmp"){
+            std::filesystem::remove(file.path(),error);
+            continue;
+        }
+        if(name.size() != 20 || file.path().extension() != ".raw"){
+            continue;
+        }
+        //end points into hex, it has to outlive the check below
+        std::string hex = name.substr(0,16);
+        char* end = nullptr;
+        u64 key = std::strtoull(hex.c_str(),&end,16);
+        u64 size = file.file_size(error);
+        if(error || *end != 0){
+            continue;
+        }
+        blobs.push_back({file.last_write_time(error),{key,size}});
+    }
+    std::sort(blobs.begin(),blobs.end());
+    std::vector<u64> removed;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(const auto& blob : blobs){
+            touchSpillLocked(blob.second.first,blob.second.second,removed);
+        }
+    }
+    removeSpilled(removed);
+}
+
+void ImageCache::touchSpillLocked(u64 key,u64 size,std::vector<u64>& removed){
+    auto it = spillFiles.find(key);
+    if(it != spillFiles.end()){
+        spillLru.splice(spillLru.begin(),spillLru,it->second.lruPosition);
+        //a colliding key overwrote the blob
+        stats.spillBytesUsed += size - it->second.size;
+        it->second.size = size;
+        return;
+    }
+    spillLru.push_front(key);
+    SpillFile& file = spillFiles[key];
+    file.size = size;
+    file.lruPosition = spillLru.begin();
+    stats.spillBytesUsed += size;
+    //never the blob just added
+    while(stats.spillBytesUsed > spillBudget && spillLru.size() > 1){
+        u64 oldKey = spillLru.back();
+        auto oldest = spillFiles.find(oldKey);
+        stats.spillBytesUsed -= oldest->second.size;
+        stats.spillRemovals++;
+        spillFiles.erase(oldest);
+        spillLru.pop_back();
+        removed.push_back(oldKey);
+    }
+}
+
+//Deleting a blob that is mapped somewhere is fine, the mapping stays valid until it is unmapped
+void ImageCache::removeSpilled(const std::vector<u64>& removed){
+    for(u64 key : removed){
+        std::error_code error;
+        std::filesystem::remove(spillPath(key),error);
+    }
+}
+
+bool ImageCache::lookup(u64 key,u64 check,CachedImage& image){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if(it != entries.end()){
+            if(it->second.check != check){
+                stats.collisions++;
+                stats.misses++;
+                return false;
+            }
+            //move to front
+            lru.splice(lru.begin(),lru,it->second.lruPosition);
+            image = it->second.image;
+            stats.hits++;
+            return true;
+        }
+    }
+    //map outside the lock, other threads keep hitting the memory cache meanwhile
+    if(!spillDirectory.empty() && loadSpilled(key,check,image)){
+        std::vector<Evicted> evicted;
+        std::vector<u64> removed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stats.spillHits++;
+            touchSpillLocked(key,spillHeaderSize + image.size,removed);
+            if(entries.find(key) == entries.end()){
+                insertLocked(key,check,image,true,evicted);
+            }
+        }
+        removeSpilled(removed);
+        for(const Evicted& entry : evicted){
+            spill(entry);
+        }
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    stats.misses++;
+    return false;
+}
+
+void ImageCache::insert(u64 key,u64 check,const CachedImage& image){
+    std::vector<Evicted> evicted;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if(it != entries.end()){
+            if(it->second.check == check){
+                return;
+            }
+            eraseLocked(it);
+        }
+        insertLocked(key,check,image,false,evicted);
+    }
+    //writing blobs can be slow so its done after releasing the lock
+    for(const Evicted& entry : evicted){
+        spill(entry);
+    }
+}
+
+CacheStats ImageCache::getStats() const{
+    std::unique_lock<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ImageCache::eraseLocked(std::unordered_map<u64,Entry>::iterator it){
+    stats.bytesUsed -= it->second.image.size;
+    lru.erase(it->second.lruPosition);
+    entries.erase(it);
+}
+
+void ImageCache::insertLocked(u64 key,u64 check,const CachedImage& image,bool onDisk,std::vector<Evicted>& evicted){
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.image = image;
+    entry.check = check;
+    entry.onDisk = onDisk;
+    entry.lruPosition = lru.begin();
+    stats.bytesUsed += image.size;
+
+    //evict least recently used entries, never the one just inserted
+    while(stats.bytesUsed > byteBudget && lru.size() > 1){
+        u64 oldKey = lru.back();
+        auto it = entries.find(oldKey);
+        stats.bytesUsed -= it->second.image.size;
+        stats.evictions++;
+        if(!spillDirectory.empty() && !it->second.onDisk){
+            evicted.push_back({oldKey,it->second.check,it->second.image});
+            stats.spills++;
+        }
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+std::string ImageCache::spillPath(u64 key) const{
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.raw",key);
+    return (std::filesystem::path(spillDirectory) / name).string();
+}
+
+//A blob left by an earlier eviction or run, written for the same source
+static bool spilledCheckMatches(const std::string& path,u64 check){
+    std::ifstream ifs(path,std::ios::binary);
+    u32 header[6];
+    if(!ifs || !ifs.read((char*)header,spillHeaderSize) || std::memcmp(&header[0],spillMagic,4) != 0){
+        return false;
+    }
+    u64 spilledCheck;
+    std::memcpy(&spilledCheck,&header[4],8);
+    return spilledCheck == check;
+}
+
+bool ImageCache::spill(const Evicted& entry){
+    const u64 key = entry.key;
+    const CachedImage& image = entry.image;
+    u64 blobSize = spillHeaderSize + image.size;
+    if(blobSize > spillBudget){
+        return false;
+    }
+    std::string path = spillPath(key);
+    std::error_code error;
+    std::vector<u64> removed;
+    if(spilledCheckMatches(path,entry.check)){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            touchSpillLocked(key,blobSize,removed);
+        }
+        removeSpilled(removed);
+        return true;
+    }
+    //write under a temporary name so a concurrent lookup never maps a half written blob
+    std::ostringstream tempName;
+    tempName << path << "." << std::this_thread::get_id() << ".tmp";
+    std::string tempPath = tempName.str();
+    std::ofstream ofs(tempPath,std::ios::binary);
+    if(!ofs){
+        std::cerr << "Failed to open " << tempPath << "\n";
+        return false;
+    }
+    u32 header[6] = {0,image.width,image.height,image.channels,0,0};
+    std::memcpy(&header[0],spillMagic,4);
+    std::memcpy(&header[4],&entry.check,8);
+    ofs.write((const char*)header,spillHeaderSize);
+    ofs.write((const char*)image.pixels.get(),image.size);
+    ofs.close();
+    if(!ofs){
+        std::cerr << "Failed to write " << tempPath << "\n";
+        std::filesystem::remove(tempPath,error);
+        return false;
+    }
+    std::filesystem::rename(tempPath,path,error);
+    if(error){
+        std::filesystem::remove(tempPath,error);
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        touchSpillLocked(key,blobSize,removed);
+    }
+    removeSpilled(removed);
+    return true;
+}
+
+bool ImageCache::loadSpilled(u64 key,u64 check,CachedImage& image){
+    std::string path = spillPath(key);
+#ifndef _WIN32
+    int fd = open(path.c_str(),O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat fileStat;
+    if(fstat(fd,&fileStat) != 0 || (size_t)fileStat.st_size < spillHeaderSize){
+        close(fd);
+        return false;
+    }
+    size_t mappedSize = (size_t)fileStat.st_size;
+    void* mapped = mmap(nullptr,mappedSize,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        return false;
+    }
+    const u8* base = (const u8*)mapped;
+    u32 header[6];
+    std::memcpy(header,base,spillHeaderSize);
+    u32 channels = header[3];
+    size_t pixelBytes = (size_t)header[1]*header[2]*channels;
+    if(std::memcmp(&header[0],spillMagic,4) != 0 || (channels != 3 && channels != 4) || pixelBytes != mappedSize - spillHeaderSize){
+        std::cerr << "Corrupt cache spill file " << path << "\n";
+        munmap(mapped,mappedSize);
+        return false;
+    }
+    u64 spilledCheck;
+    std::memcpy(&spilledCheck,&header[4],8);
+    if(spilledCheck != check){
+        //a colliding key, counted as a miss
+        std::unique_lock<std::mutex> lock(mutex);
+        stats.collisions++;
+        munmap(mapped,mappedSize);
+        return false;
+    }
+    image.width = header[1];
+    image.height = header[2];
+    image.channels = channels;
+    image.size = pixelBytes;
+    image.pixels = std::shared_ptr<const u8>(base + spillHeaderSize,[mapped,mappedSize](const u8*){
+        munmap(mapped,mappedSize);
+    });
+    return true;
+#else
+    std::ifstream ifs(path,std::ios::binary);
+    if(!ifs){
+        return false;
+    }
+    u32 header[6];
+    if(!ifs.read((char*)header,spillHeaderSize) || std::memcmp(&header[0],spillMagic,4) != 0){
+        return false;
+    }
+    u32 channels = header[3];
+    u64 spilledCheck;
+    std::memcpy(&spilledCheck,&header[4],8);
+    if(channels != 3 && channels != 4){
+        return false;
+    }
+    if(spilledCheck != check){
+        std::unique_lock<std::mutex> lock(mutex);
+        stats.collisions++;
+        return false;
+    }
+    size_t pixelBytes = (size_t)header[1]*header[2]*channels;
+    u8* pixels = (u8*)malloc(pixelBytes);
+    if(!ifs.read((char*)pixels,pixelBytes)){
+        free(pixels);
+        return false;
+    }
+    image.width = header[1];
+    image.height = header[2];
+    image.channels = channels;
+    image.size = pixelBytes;
+    image.pixels = std::shared_ptr<const u8>(pixels,[](const u8* p){ free((void*)p); });
+    return true;
+#endif
+}
+
+static inline u64 rotateLeft(u64 value,u32 amount){
+    return (value << amount) | (value >> (64 - amount));
+}
+
+//splitmix64 finalizer
+static inline u64 mix(u64 value){
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return value;
+}
+
+u64 ImageCache::hashBytes(const u8* data,size_t size){
+    const u64 prime = 0x9E3779B97F4A7C15ull;
+    //4 independent lanes so the multiplies can overlap
+    u64 lanes[4] = {prime,prime*2,prime*3,prime*4};
+    size_t i=0;
+    for(;i+32<=size;i+=32){
+        for(u32 lane=0;lane<4;lane++){
+            u64 word;
+            std::memcpy(&word,data+i+lane*8,8);
+            lanes[lane] = rotateLeft(lanes[lane] ^ (word * prime),29) * 0xC2B2AE3D27D4EB4Full;
+        }
+    }
+    u64 hash = (u64)size * prime;
+    for(u32 lane=0;lane<4;lane++){
+        hash = rotateLeft(hash ^ mix(lanes[lane]),27) * prime;
+    }
+    for(;i+8<=size;i+=8){
+        u64 word;
+        std::memcpy(&word,data+i,8);
+        hash = rotateLeft(hash ^ (word * prime),31) * 0xC2B2AE3D27D4EB4Full;
+    }
+    for(;i<size;i++){
+        hash = rotateLeft(hash ^ (data[i] * prime),11) * 0xC2B2AE3D27D4EB4Full;
+    }
+    return mix(hash);
+}
+
+u64 ImageCache::hashFileIdentity(const std::string& filepath){
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::absolute(filepath,error);
+    if(error)return 0;
+    u64 fileSize = std::filesystem::file_size(path,error);
+    if(error)return 0;
+    auto modified = std::filesystem::last_write_time(path,error);
+    if(error)return 0;
+
+    std::string pathString = path.string();
+    u64 hash = hashBytes((const u8*)pathString.data(),pathString.size());
+    hash = mix(hash ^ fileSize);
+    hash = mix(hash ^ (u64)modified.time_since_epoch().count());
+    return hash;
+}
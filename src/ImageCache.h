@@ -0,0 +1,96 @@
+#ifndef IMAGECACHE
+#define IMAGECACHE
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+typedef unsigned long long u64;
+
+//A decoded, defiltered rgb or rgba image. pixels is either heap memory or a mapped spill file
+struct CachedImage{
+    u32 width=0;
+    u32 height=0;
+    u32 channels=3;
+    size_t size=0;
+    std::shared_ptr<const u8> pixels;
+};
+
+struct CacheStats{
+    u64 hits=0;         //found in memory
+    u64 spillHits=0;    //mapped back from the spill directory
+    u64 misses=0;
+    u64 evictions=0;
+    u64 spills=0;       //blobs written to the spill directory
+    u64 spillRemovals=0;    //blobs deleted to stay inside the disk budget
+    u64 collisions=0;   //the key matched but the check did not
+    size_t bytesUsed=0;
+    u64 spillBytesUsed=0;
+};
+
+/*
+    In process LRU of decoded images with a byte budget.
+    When a spill directory is given, evicted images are written there as raw
+    pixel blobs and mapped straight back on a later lookup. The blobs have their own
+    LRU with a disk budget, blobs left by an earlier run are picked up (oldest first)
+    and the least recently used ones are deleted once the budget is exceeded.
+    Every entry (and blob) also stores a check value of its source, usually the file size,
+    a lookup only hits when key and check both match so colliding keys never share pixels.
+    All public functions can be called from several threads.
+*/
+class ImageCache{
+    struct Entry{
+        CachedImage image;
+        u64 check=0;
+        bool onDisk=false;
+        std::list<u64>::iterator lruPosition;
+    };
+    struct Evicted{
+        u64 key;
+        u64 check;
+        CachedImage image;
+    };
+    struct SpillFile{
+        u64 size=0;
+        std::list<u64>::iterator lruPosition;
+    };
+    std::list<u64> lru; //front is the most recently used
+    std::unordered_map<u64,Entry> entries;
+    size_t byteBudget;
+    std::string spillDirectory;
+    std::list<u64> spillLru;    //front is the most recently used blob
+    std::unordered_map<u64,SpillFile> spillFiles;
+    u64 spillBudget;
+    CacheStats stats;
+    mutable std::mutex mutex;
+
+    void insertLocked(u64 key,u64 check,const CachedImage& image,bool onDisk,std::vector<Evicted>& evicted);
+    void eraseLocked(std::unordered_map<u64,Entry>::iterator it);
+    std::string spillPath(u64 key) const;
+    bool spill(const Evicted& entry);
+    //false for a missing or broken blob and for one with a different check
+    bool loadSpilled(u64 key,u64 check,CachedImage& image);
+    void scanSpillDirectory();
+    //marks the blob as most recently used and collects the blobs past the disk budget
+    void touchSpillLocked(u64 key,u64 size,std::vector<u64>& removed);
+    void removeSpilled(const std::vector<u64>& removed);
+    public:
+    //spillBudget bounds the bytes kept in the spill directory
+    ImageCache(size_t _byteBudget,const std::string& _spillDirectory = "",u64 _spillBudget = (u64)1 << 30);
+    bool lookup(u64 key,u64 check,CachedImage& image);
+    //an entry under the same key with a different check is replaced
+    void insert(u64 key,u64 check,const CachedImage& image);
+    CacheStats getStats() const;
+
+    //Key from the file contents
+    static u64 hashBytes(const u8* data,size_t size);
+    //Key from path + modification time + size, doesnt need to read the file. Returns 0 on failure
+    static u64 hashFileIdentity(const std::string& filepath);
+};
+
+#endif
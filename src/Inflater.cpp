@@ -0,0 +1,372 @@
+#include "Inflater.h"
+#include "Checksum.h"
+#include <iostream>
+#include <algorithm>
+
+//length symbols 257 - 285
+static const u32 lengthBase[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258
+};
+static const u32 lengthExtraBits[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+};
+//distance symbols 0 - 29
+static const u32 distanceBase[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577
+};
+static const u32 distanceExtraBits[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
+};
+//order in which the code length code lengths are stored
+static const u32 codeLengthOrder[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+
+static inline u32 lowBits(u64 bits,u32 count){
+    return (u32)(bits & ((1ull << count) - 1));
+}
+
+//Like zlib, a set of code lengths has to use up the whole code space. The exceptions are a set
+//without codes and, where allowSingle, a lone code of length 1
+static bool isCompleteCode(const u32* lengths,u32 count,bool allowSingle){
+    u32 perLength[16] = {0};
+    u32 maxLength = 0;
+    for(u32 i=0;i<count;i++){
+        perLength[lengths[i]]++;
+        maxLength = std::max(maxLength,lengths[i]);
+    }
+    if(maxLength == 0 || (allowSingle && maxLength == 1)){
+        return true;
+    }
+    int left = 1;
+    for(u32 length=1;length<16;length++){
+        left = left*2 - (int)perLength[length];
+        if(left < 0){
+            return false;
+        }
+    }
+    return left == 0;
+}
+
+//Fixed huffman trees from the rfc, built once
+static const HuffmanTree& fixedLiteralTree(){
+    static const HuffmanTree tree = [](){
+        u32 cLen[288];
+        for(u32 i=0;i<144;i++)cLen[i] = 8;
+        for(u32 i=144;i<256;i++)cLen[i] = 9;
+        for(u32 i=256;i<280;i++)cLen[i] = 7;
+        for(u32 i=280;i<288;i++)cLen[i] = 8;
+        HuffmanTree fixedTree;
+        fixedTree.buildFromCodeLengths(cLen,288);
+        return fixedTree;
+    }();
+    return tree;
+}
+
+static const HuffmanTree& fixedDistanceTree(){
+    static const HuffmanTree tree = [](){
+        u32 cLen[30];
+        for(u32 i=0;i<30;i++)cLen[i] = 5;
+        HuffmanTree fixedTree;
+        fixedTree.buildFromCodeLengths(cLen,30);
+        return fixedTree;
+    }();
+    return tree;
+}
+
+Inflater::Inflater(OutputCallback _onOutput,bool _zlibStream)
+:onOutput(_onOutput),zlibStream(_zlibStream),state(_zlibStream?STATE_ZLIB_HEADER:STATE_BLOCK_HEADER),lastBlock(false),
+window(windowSize,0),windowPos(0),flushedPos(0),adler(1),
+storedRemaining(0),hLit(0),hDist(0),hClen(0),lengthIndex(0),literalTree(nullptr),distanceTree(nullptr)
+{
+
+}
+
+bool Inflater::finished() const{
+    return state == STATE_DONE;
+}
+
+u64 Inflater::totalOut() const{
+    return windowPos;
+}
+
+Inflater::Status Inflater::fail(const char* message){
+    std::cerr << "Inflate error: " << message << "\n";
+    state = STATE_ERROR;
+    return INFLATE_ERROR;
+}
+
+void Inflater::putByte(u8 value){
+    window[windowPos & windowMask] = value;
+    windowPos++;
+    //never let unflushed bytes get overwritten by the window wrapping around
+    if(windowPos - flushedPos >= windowSize/2){
+        flushOutput();
+    }
+}
+
+void Inflater::copyMatch(u32 length,u32 distance){
+    for(u32 i=0;i<length;i++){
+        putByte(window[(windowPos - distance) & windowMask]);
+    }
+}
+
+void Inflater::flushOutput(){
+    while(flushedPos < windowPos){
+        u32 start = (u32)(flushedPos & windowMask);
+        u32 count = (u32)std::min<u64>(windowPos - flushedPos,windowSize - start);
+        const u8* data = window.data() + start;
+
+        adler = adler32(adler,data,count);
+        onOutput(data,count);
+        flushedPos += count;
+    }
+}
+
+Inflater::Status Inflater::decodeCodeLengths(){
+    while(lengthIndex < hLit + hDist){
+        bitReader.refill();
+        u32 bitlength = 0;
+        u32 symbol = codeLengthTree.decodeLE((u32)bitReader.bitBuffer,bitReader.bitCount,bitlength);
+        if(symbol == HUFFMAN_NEED_BITS)return INFLATE_NEED_INPUT;
+        if(symbol == HUFFMAN_INVALID_CODE)return fail("invalid code length code");
+
+        if(symbol < 16){
+            bitReader.dropBits(bitlength);
+            codeLengths[lengthIndex++] = symbol;
+            continue;
+        }
+        //16 = repeat previous 3-6 times, 17 = 3-10 zeros, 18 = 11-138 zeros
+        u32 extraBits = (symbol == 16) ? 2 : ((symbol == 17) ? 3 : 7);
+        u32 minRepeat = (symbol == 18) ? 11 : 3;
+        if(bitlength + extraBits > bitReader.bitCount)return INFLATE_NEED_INPUT;
+        u32 repeat = minRepeat + lowBits(bitReader.bitBuffer >> bitlength,extraBits);
+        u32 value = 0;
+        if(symbol == 16){
+            if(lengthIndex == 0)return fail("repeat code without a previous length");
+            value = codeLengths[lengthIndex-1];
+        }
+        if(lengthIndex + repeat > hLit + hDist)return fail("code lengths overflow");
+        bitReader.dropBits(bitlength + extraBits);
+        for(u32 i=0;i<repeat;i++){
+            codeLengths[lengthIndex++] = value;
+        }
+    }
+
+    if(codeLengths[256] == 0)return fail("no end of block code");
+    if(!isCompleteCode(codeLengths,hLit,true))return fail("incomplete literal/length code");
+    if(!isCompleteCode(codeLengths + hLit,hDist,true))return fail("incomplete distance code");
+    //blocks with the same header (in this stream or an earlier one) reuse the trees
+    dynamicTables = HuffmanTableCache::shared().get(codeLengths,hLit,hDist);
+    if(!dynamicTables)return fail("invalid literal/length or distance code lengths");
+    literalTree = &dynamicTables->literalTree;
+    distanceTree = &dynamicTables->distanceTree;
+    return INFLATE_DONE;
+}
+
+/*
+    Every literal or <length,distance> pair is consumed as a whole, if the
+    buffered bits dont hold all of it nothing is consumed and decoding
+    resumes from the same symbol once more input arrives.
+    (a full pair is at most 15+5+15+13 = 48 bits)
+*/
+Inflater::Status Inflater::decodeBlockData(){
+    while(true){
+        bitReader.refill();
+        u64 bits = bitReader.bitBuffer;
+        u32 available = bitReader.bitCount;
+        u32 bitlength = 0;
+        u32 symbol = literalTree->decodeLE((u32)bits,available,bitlength);
+        if(symbol == HUFFMAN_NEED_BITS)return INFLATE_NEED_INPUT;
+        if(symbol == HUFFMAN_INVALID_CODE)return fail("invalid literal/length code");
+
+        if(symbol < 256){
+            bitReader.dropBits(bitlength);
+            putByte((u8)symbol);
+            continue;
+        }
+        if(symbol == 256){
+            bitReader.dropBits(bitlength);
+            return INFLATE_DONE;
+        }
+        if(symbol > 285)return fail("invalid length symbol");
+
+        u32 used = bitlength;
+        u32 lengthSymbol = symbol - 257;
+        u32 extraBits = lengthExtraBits[lengthSymbol];
+        if(used + extraBits > available)return INFLATE_NEED_INPUT;
+        u32 length = lengthBase[lengthSymbol] + lowBits(bits >> used,extraBits);
+        used += extraBits;
+
+        u32 distanceSymbol = distanceTree->decodeLE((u32)(bits >> used),available - used,bitlength);
+        if(distanceSymbol == HUFFMAN_NEED_BITS)return INFLATE_NEED_INPUT;
+        if(distanceSymbol == HUFFMAN_INVALID_CODE || distanceSymbol > 29)return fail("invalid distance code");
+        used += bitlength;
+        extraBits = distanceExtraBits[distanceSymbol];
+        if(used + extraBits > available)return INFLATE_NEED_INPUT;
+        u32 distance = distanceBase[distanceSymbol] + lowBits(bits >> used,extraBits);
+        used += extraBits;
+
+        if(distance > windowPos)return fail("distance is further back than the start of the stream");
+        bitReader.dropBits(used);
+        copyMatch(length,distance);
+    }
+}
+
+Inflater::Status Inflater::feed(const u8* data,size_t size){
+    bitReader.setInput(data,size);
+    while(true){
+        Status step = INFLATE_DONE;
+        switch(state){
+            case STATE_ZLIB_HEADER:{
+                if(!bitReader.ensureBits(16)){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                u32 cmf = bitReader.readBitsLE(8);
+                u32 flg = bitReader.readBitsLE(8);
+                if((cmf & 0x0f) != 8 || ((cmf << 8) | flg) % 31 != 0){
+                    return fail("invalid zlib header");
+                }
+                if(flg & 32){
+                    return fail("preset dictionaries are not supported");
+                }
+                state = STATE_BLOCK_HEADER;
+                break;
+            }
+            case STATE_BLOCK_HEADER:{
+                if(!bitReader.ensureBits(3)){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                lastBlock = bitReader.readBitsLE(1);
+                u32 compressionType = bitReader.readBitsLE(2);
+                if(compressionType == 0){
+                    bitReader.alignToByte();
+                    state = STATE_STORED_LENGTHS;
+                }else if(compressionType == 1){
+                    literalTree = &fixedLiteralTree();
+                    distanceTree = &fixedDistanceTree();
+                    state = STATE_BLOCK_DATA;
+                }else if(compressionType == 2){
+                    state = STATE_DYNAMIC_COUNTS;
+                }else{
+                    return fail("reserved block type");
+                }
+                break;
+            }
+            case STATE_STORED_LENGTHS:{
+                if(!bitReader.ensureBits(32)){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                u32 len = bitReader.readBitsLE(16);
+                u32 nlen = bitReader.readBitsLE(16);
+                if((len ^ 0xffff) != nlen){
+                    return fail("LEN NLEN do not match");
+                }
+                storedRemaining = len;
+                state = STATE_STORED_COPY;
+                break;
+            }
+            case STATE_STORED_COPY:{
+                //whole bytes that are already buffered go first
+                while(storedRemaining > 0 && bitReader.bitCount >= 8){
+                    putByte((u8)bitReader.readBitsLE(8));
+                    storedRemaining--;
+                }
+                u32 count = (u32)std::min<size_t>(storedRemaining,bitReader.bytesAvailable());
+                for(u32 i=0;i<count;i++){
+                    putByte(bitReader.reader[i]);
+                }
+                bitReader.reader += count;
+                bitReader.bytesPushed += count;
+                storedRemaining -= count;
+                if(storedRemaining > 0){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                state = lastBlock ? STATE_ADLER32 : STATE_BLOCK_HEADER;
+                break;
+            }
+            case STATE_DYNAMIC_COUNTS:{
+                if(!bitReader.ensureBits(14)){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                hLit = bitReader.readBitsLE(5) + 257;
+                hDist = bitReader.readBitsLE(5) + 1;
+                hClen = bitReader.readBitsLE(4) + 4;
+                if(hLit > 286 || hDist > 30){
+                    return fail("too many length or distance codes");
+                }
+                lengthIndex = 0;
+                std::fill(codeLengths,codeLengths + 19,0);
+                state = STATE_DYNAMIC_CODE_LENGTH_LENGTHS;
+                break;
+            }
+            case STATE_DYNAMIC_CODE_LENGTH_LENGTHS:{
+                while(lengthIndex < hClen && bitReader.ensureBits(3)){
+                    codeLengths[codeLengthOrder[lengthIndex++]] = bitReader.readBitsLE(3);
+                }
+                if(lengthIndex < hClen){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                if(!isCompleteCode(codeLengths,19,false) || !codeLengthTree.buildFromCodeLengths(codeLengths,19)){
+                    return fail("invalid code length code lengths");
+                }
+                lengthIndex = 0;
+                state = STATE_DYNAMIC_CODE_LENGTHS;
+                break;
+            }
+            case STATE_DYNAMIC_CODE_LENGTHS:{
+                step = decodeCodeLengths();
+                if(step == INFLATE_DONE){
+                    state = STATE_BLOCK_DATA;
+                }
+                break;
+            }
+            case STATE_BLOCK_DATA:{
+                step = decodeBlockData();
+                if(step == INFLATE_DONE){
+                    state = lastBlock ? STATE_ADLER32 : STATE_BLOCK_HEADER;
+                }
+                break;
+            }
+            case STATE_ADLER32:{
+                if(!zlibStream){
+                    flushOutput();
+                    state = STATE_DONE;
+                    break;
+                }
+                bitReader.alignToByte();
+                if(!bitReader.ensureBits(32)){
+                    step = INFLATE_NEED_INPUT;
+                    break;
+                }
+                //stored most significant byte first
+                u32 expected = 0;
+                for(u32 i=0;i<4;i++){
+                    expected = (expected << 8) | bitReader.readBitsLE(8);
+                }
+                flushOutput();
+                if(expected != adler){
+                    return fail("adler32 mismatch");
+                }
+                state = STATE_DONE;
+                break;
+            }
+            case STATE_DONE:
+                flushOutput();
+                return INFLATE_DONE;
+            case STATE_ERROR:
+                return INFLATE_ERROR;
+        }
+        if(step == INFLATE_NEED_INPUT){
+            flushOutput();
+            return INFLATE_NEED_INPUT;
+        }
+        if(step == INFLATE_ERROR){
+            return INFLATE_ERROR;
+        }
+    }
+}
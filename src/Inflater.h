@@ -0,0 +1,78 @@
+#ifndef INFLATER
+#define INFLATER
+
+#include <vector>
+#include <functional>
+#include "BitReader.h"
+#include "HuffmanTableCache.h"
+
+/*
+    Resumable zlib/deflate decoder.
+    feed() can be called with slices of any size, decoding stops when the
+    slice runs out (even in the middle of a huffman code) and carries on
+    from the same spot with the next slice.
+    Decompressed bytes are handed to onOutput in order, only the 32KiB
+    deflate window is kept.
+*/
+class Inflater{
+    public:
+    enum Status{
+        INFLATE_NEED_INPUT=0,
+        INFLATE_DONE,
+        INFLATE_ERROR
+    };
+    typedef std::function<void(const u8* data,size_t size)> OutputCallback;
+
+    Inflater(OutputCallback _onOutput,bool _zlibStream = true);
+    Status feed(const u8* data,size_t size);
+    bool finished() const;
+    u64 totalOut() const;
+
+    private:
+    enum State{
+        STATE_ZLIB_HEADER=0,
+        STATE_BLOCK_HEADER,
+        STATE_STORED_LENGTHS,
+        STATE_STORED_COPY,
+        STATE_DYNAMIC_COUNTS,
+        STATE_DYNAMIC_CODE_LENGTH_LENGTHS,
+        STATE_DYNAMIC_CODE_LENGTHS,
+        STATE_BLOCK_DATA,
+        STATE_ADLER32,
+        STATE_DONE,
+        STATE_ERROR
+    };
+    static const u32 windowSize = 32768;
+    static const u32 windowMask = windowSize - 1;
+
+    OutputCallback onOutput;
+    bool zlibStream;
+    State state;
+    bool lastBlock;
+    StreamBitReader bitReader;
+
+    std::vector<u8> window;
+    u64 windowPos;      //total bytes written to the window
+    u64 flushedPos;     //total bytes handed to onOutput
+    u32 adler;
+
+    u32 storedRemaining;
+    u32 hLit;
+    u32 hDist;
+    u32 hClen;
+    u32 lengthIndex;
+    u32 codeLengths[286+32];
+    HuffmanTree codeLengthTree;
+    std::shared_ptr<const HuffmanTables> dynamicTables; //from HuffmanTableCache::shared()
+    const HuffmanTree* literalTree;
+    const HuffmanTree* distanceTree;
+
+    Status fail(const char* message);
+    void putByte(u8 value);
+    void copyMatch(u32 length,u32 distance);
+    void flushOutput();
+    Status decodeCodeLengths();
+    Status decodeBlockData();
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+#include <iostream>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+:mapped(nullptr),mappedSize(0),releasedUpTo(0)
+{
+
+}
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+u8* MappedFile::data(){
+    return mapped;
+}
+
+size_t MappedFile::size() const{
+    return mappedSize;
+}
+
+#ifndef _WIN32
+bool MappedFile::create(const std::string& filepath,size_t size){
+    close();
+    int fd = open(filepath.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+    if(fd < 0){
+        std::cerr << "Failed to open " << filepath << "\n";
+        return false;
+    }
+    if(ftruncate(fd,(off_t)size) != 0){
+        std::cerr << "Failed to resize " << filepath << " to " << size << " Bytes\n";
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(address == MAP_FAILED){
+        std::cerr << "Failed to map " << filepath << "\n";
+        return false;
+    }
+    mapped = (u8*)address;
+    mappedSize = size;
+    releasedUpTo = 0;
+    return true;
+}
+
+void MappedFile::release(size_t offset){
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    //only whole pages can be dropped
+    offset = std::min(offset,mappedSize) / pageSize * pageSize;
+    if(offset <= releasedUpTo)return;
+    u8* start = mapped + releasedUpTo;
+    size_t length = offset - releasedUpTo;
+    msync(start,length,MS_ASYNC);
+    //the mapping is shared with the file so the written data is kept
+    madvise(start,length,MADV_DONTNEED);
+    releasedUpTo = offset;
+}
+
+void MappedFile::close(){
+    if(mapped){
+        msync(mapped,mappedSize,MS_SYNC);
+        munmap(mapped,mappedSize);
+    }
+    mapped = nullptr;
+    mappedSize = 0;
+    releasedUpTo = 0;
+}
+#else
+bool MappedFile::create(const std::string& filepath,size_t size){
+    (void)filepath;
+    (void)size;
+    std::cerr << "Mapped output files are not supported on this platform\n";
+    return false;
+}
+
+void MappedFile::release(size_t offset){
+    (void)offset;
+}
+
+void MappedFile::close(){
+
+}
+#endif
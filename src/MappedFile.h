@@ -0,0 +1,27 @@
+#ifndef MAPPEDFILE
+#define MAPPEDFILE
+
+#include <string>
+#include <cstddef>
+
+typedef unsigned char u8;
+
+//Output file of a fixed size mapped into memory for writing
+class MappedFile{
+    u8* mapped;
+    size_t mappedSize;
+    size_t releasedUpTo;
+    public:
+    MappedFile();
+    ~MappedFile();
+    //creates (or truncates) the file with the given size and maps it, false if mapping is not available
+    bool create(const std::string& filepath,size_t size);
+    u8* data();
+    size_t size() const;
+    //starts writing back everything below offset and drops those pages from memory,
+    //written data stays in the file so resident memory doesnt grow with the file size
+    void release(size_t offset);
+    void close();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "OutOfCore.h"
+#include "MappedFile.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+bool decodeToFile(const std::string& inputPath,const std::string& outputPath,bool mapped,const DecodeLimits& limits){
+    std::ifstream file(inputPath, std::ios::binary);
+    if(!file){
+        std::cerr << "Failed to open file " << inputPath << "\n";
+        return false;
+    }
+    MappedFile mappedFile;
+    std::ofstream sink;
+    size_t headerSize = 0;
+    size_t outputRowBytes = 0;
+    u32 pixelBytes = 3;
+    bool outputReady = false;
+    std::vector<u8> rgbRow;
+    StreamDecoder decoder(
+        [&](const ImageHeader& header){
+            std::string ppmHeader = "P6\n" + std::to_string(header.width) + " " + std::to_string(header.height) + "\n255\n";
+            headerSize = ppmHeader.size();
+            pixelBytes = header.colorType == 6 ? 4 : 3;
+            outputRowBytes = (size_t)header.width*3;
+            rgbRow.resize(outputRowBytes);
+            //the whole output has to fit in the address space to be mapped
+            u64 outputSize = (u64)outputRowBytes*header.height;
+            if(mapped && outputSize <= (u64)(SIZE_MAX - headerSize)){
+                if(mappedFile.create(outputPath,headerSize + (size_t)outputSize)){
+                    std::memcpy(mappedFile.data(),ppmHeader.data(),headerSize);
+                    outputReady = true;
+                    return;
+                }
+            }
+            if(mapped){
+                std::cout << "Falling back to a streamed output file\n";
+                mapped = false;
+            }
+            sink.open(outputPath,std::ios::binary);
+            outputReady = sink.is_open() && sink.write(ppmHeader.data(),headerSize);
+        },
+        [&](u32 y,const u8* row){
+            if(!outputReady)return;
+            const u8* rgb = row;
+            if(pixelBytes == 4){
+                //alpha is dropped
+                for(size_t x=0;x<outputRowBytes/3;x++){
+                    rgbRow[x*3+0] = row[x*4+0];
+                    rgbRow[x*3+1] = row[x*4+1];
+                    rgbRow[x*3+2] = row[x*4+2];
+                }
+                rgb = rgbRow.data();
+            }
+            if(mapped){
+                size_t offset = headerSize + (size_t)y*outputRowBytes;
+                std::memcpy(mappedFile.data() + offset,rgb,outputRowBytes);
+                mappedFile.release(offset);
+            }else{
+                sink.write((const char*)rgb,outputRowBytes);
+            }
+        }
+    );
+    decoder.setLimits(limits);
+
+    std::vector<char> slice(65536);
+    while(file){
+        file.read(slice.data(),slice.size());
+        std::streamsize count = file.gcount();
+        if(count <= 0)break;
+        if(!decoder.feed((const u8*)slice.data(),(size_t)count)){
+            std::cerr << "Failed to parse the PNG\n";
+            return false;
+        }
+        if(decoder.getHeader().width != 0 && !outputReady){
+            std::cerr << "Failed to create " << outputPath << "\n";
+            return false;
+        }
+    }
+    if(!decoder.finished()){
+        std::cerr << "The PNG file ended early\n";
+        return false;
+    }
+    mappedFile.close();
+    sink.close();
+    if(!mapped && !sink){
+        std::cerr << "Failed to write " << outputPath << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef OUTOFCORE
+#define OUTOFCORE
+
+#include <string>
+#include "StreamDecoder.h"
+
+/*
+    Out of core decode for images that dont fit in memory.
+    The input is read in slices and every scanline goes straight into the output (binary ppm, alpha is dropped),
+    either a mapped file whose finished pages are released as rows complete or a streamed file.
+    Only the deflate window, two scanlines and one input slice stay resident.
+    mapped falls back to a streamed file when the output cant be mapped.
+    limits.maxImageBytes is not needed here, the row limit and the spec limits still apply.
+*/
+bool decodeToFile(const std::string& inputPath,const std::string& outputPath,bool mapped,const DecodeLimits& limits = DecodeLimits());
+
+#endif
@@ -0,0 +1,187 @@
+#include "PNGEncoder.h"
+#include "Checksum.h"
+#include "Defilter.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//IDAT data is split into chunks of this size
+static const u32 maxIDATSize = 1 << 20;
+
+static void appendBigEndian32(std::vector<u8>& out,u32 value){
+    out.push_back((u8)(value >> 24));
+    out.push_back((u8)(value >> 16));
+    out.push_back((u8)(value >> 8));
+    out.push_back((u8)value);
+}
+
+void writeChunk(std::vector<u8>& png,const char type[4],const u8* data,u32 length){
+    appendBigEndian32(png,length);
+    size_t typeOffset = png.size();
+    png.insert(png.end(),type,type + 4);
+    if(length > 0){
+        png.insert(png.end(),data,data + length);
+    }
+    //crc covers the type and the data
+    appendBigEndian32(png,crc32(0,png.data() + typeOffset,length + 4));
+}
+
+//Filtered bytes are treated as signed, sum of |value|
+static u64 sumAbsoluteDifferences(const u8* data,size_t count){
+    u64 sum = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for(;i+16<=count;i+=16){
+        __m128i value = _mm_loadu_si128((const __m128i*)(data+i));
+        //|signed byte| = min(byte,-byte) as unsigned
+        __m128i absolute = _mm_min_epu8(value,_mm_sub_epi8(zero,value));
+        total = _mm_add_epi64(total,_mm_sad_epu8(absolute,zero));
+    }
+    u64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes,total);
+    sum = lanes[0] + lanes[1];
+#endif
+    for(;i<count;i++){
+        u8 value = data[i];
+        sum += value < 128 ? value : 256 - value;
+    }
+    return sum;
+}
+
+//Inverse of defilterScanline
+static void applyFilter(u8 filterType,const u8* row,const u8* prevRow,size_t rowBytes,u32 pixelBytes,u8* out){
+    for(size_t i=0;i<rowBytes;i++){
+        u8 a = (i>=pixelBytes?row[i-pixelBytes]:0);
+        u8 b = (prevRow?prevRow[i]:0);
+        u8 c = ((prevRow && i>=pixelBytes)?prevRow[i-pixelBytes]:0);
+        u8 value = row[i];
+        if(filterType == 1){
+            value = value - a;
+        }else if(filterType == 2){
+            value = value - b;
+        }else if(filterType == 3){
+            value = value - ((a + b) / 2);
+        }else if(filterType == 4){
+            value = value - paethPredictor(a,b,c);
+        }
+        out[i] = value;
+    }
+}
+
+u8 filterScanline(const u8* row,const u8* prevRow,size_t rowBytes,u32 pixelBytes,u8* out){
+    thread_local std::vector<u8> candidate;
+    candidate.resize(rowBytes);
+    u8 bestFilter = 0;
+    u64 bestSum = 0;
+    for(u8 filterType=0;filterType<=4;filterType++){
+        //up, average and paeth only differ from none/sub by the row above
+        if(!prevRow && (filterType == 2 || filterType == 4))continue;
+        u8* target = (filterType == 0) ? out + 1 : candidate.data();
+        applyFilter(filterType,row,prevRow,rowBytes,pixelBytes,target);
+        u64 sum = sumAbsoluteDifferences(target,rowBytes);
+        if(filterType == 0 || sum < bestSum){
+            if(filterType != 0){
+                std::memcpy(out + 1,target,rowBytes);
+            }
+            bestSum = sum;
+            bestFilter = filterType;
+        }
+        if(bestSum == 0)break;
+    }
+    out[0] = bestFilter;
+    return bestFilter;
+}
+
+struct EncodedBand{
+    BitWriter writer;
+    u32 adler=1;
+    size_t filteredSize=0;
+};
+
+bool encodePNG(const u8* pixels,u32 width,u32 height,u8 colorType,std::vector<u8>& png,const EncoderOptions& options){
+    if(colorType != 2 && colorType != 6){
+        std::cerr << "Only Truecolor and Truecolor and Alpha can be encoded\n";
+        return false;
+    }
+    if(width == 0 || height == 0){
+        std::cerr << "Cant encode an image without pixels\n";
+        return false;
+    }
+    const u32 pixelBytes = (colorType == 6) ? 4 : 3;
+    const size_t rowBytes = (size_t)width*pixelBytes;
+
+    u32 threadCount = options.threadCount ? options.threadCount : std::max(1u,std::thread::hardware_concurrency());
+    u32 bandRows = options.bandRows;
+    if(bandRows == 0){
+        //a couple of bands per thread, but not so small that compression suffers
+        bandRows = (threadCount == 1) ? height : std::max(16u,(height + threadCount*2 - 1)/(threadCount*2));
+    }
+    u32 bandCount = (height + bandRows - 1)/bandRows;
+    std::vector<EncodedBand> bands(bandCount);
+
+    auto encodeBand = [&](u32 band){
+        u32 firstRow = band*bandRows;
+        u32 lastRow = std::min(height,firstRow + bandRows);
+        std::vector<u8> filtered((size_t)(lastRow - firstRow)*(rowBytes + 1));
+        u8* writer = filtered.data();
+        for(u32 y=firstRow;y<lastRow;y++){
+            const u8* row = pixels + (size_t)y*rowBytes;
+            filterScanline(row,(y>0?row-rowBytes:nullptr),rowBytes,pixelBytes,writer);
+            writer += rowBytes + 1;
+        }
+        EncodedBand& encoded = bands[band];
+        encoded.filteredSize = filtered.size();
+        encoded.adler = adler32(1,filtered.data(),filtered.size());
+        Deflater::compress(filtered.data(),filtered.size(),band == bandCount-1,encoded.writer,options.deflate);
+        encoded.writer.alignToByte();
+    };
+    if(threadCount > 1 && bandCount > 1){
+        ThreadPool pool(threadCount);
+        for(u32 band=0;band<bandCount;band++){
+            pool.enqueue([&encodeBand,band](){ encodeBand(band); });
+        }
+        pool.wait();
+    }else{
+        for(u32 band=0;band<bandCount;band++){
+            encodeBand(band);
+        }
+    }
+
+    //join the bands into one zlib stream
+    std::vector<u8> zlibStream = {0x78,0x9C};
+    u32 adler = bands[0].adler;
+    for(u32 band=0;band<bandCount;band++){
+        zlibStream.insert(zlibStream.end(),bands[band].writer.buffer.begin(),bands[band].writer.buffer.end());
+        if(band > 0){
+            adler = adler32Combine(adler,bands[band].adler,bands[band].filteredSize);
+        }
+    }
+    appendBigEndian32(zlibStream,adler);
+
+    png.clear();
+    const u8 pngHeader[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    png.insert(png.end(),pngHeader,pngHeader + 8);
+
+    std::vector<u8> ihdr;
+    appendBigEndian32(ihdr,width);
+    appendBigEndian32(ihdr,height);
+    ihdr.push_back(8);          //bits per channel
+    ihdr.push_back(colorType);
+    ihdr.push_back(0);          //compression method
+    ihdr.push_back(0);          //filter method
+    ihdr.push_back(0);          //interlace method
+    writeChunk(png,"IHDR",ihdr.data(),(u32)ihdr.size());
+
+    for(size_t offset=0;offset<zlibStream.size();offset+=maxIDATSize){
+        u32 length = (u32)std::min<size_t>(maxIDATSize,zlibStream.size() - offset);
+        writeChunk(png,"IDAT",zlibStream.data() + offset,length);
+    }
+    writeChunk(png,"IEND",nullptr,0);
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef PNGENCODER
+#define PNGENCODER
+
+#include <vector>
+#include "Deflater.h"
+
+struct EncoderOptions{
+    DeflateOptions deflate;
+    u32 threadCount=1;  //more than 1 compresses bands of rows in parallel, 0 = one thread per core
+    u32 bandRows=0;     //rows per band when running in parallel, 0 = picked from the image height
+};
+
+//Appends a chunk (length, type, data, crc) to png
+void writeChunk(std::vector<u8>& png,const char type[4],const u8* data,u32 length);
+
+//Filters one scanline with the filter that has the smallest sum of absolute differences,
+//out gets the filter byte followed by rowBytes filtered bytes. Returns the filter type
+u8 filterScanline(const u8* row,const u8* prevRow,size_t rowBytes,u32 pixelBytes,u8* out);
+
+/*
+    Encodes 8 bit Truecolor (colorType 2) or Truecolor and Alpha (colorType 6) pixels,
+    pixels are tightly packed scanlines without filter bytes.
+    In parallel mode every band of rows is filtered and deflated on its own and ends
+    with a full flush, the bands are then joined into a single zlib stream.
+*/
+bool encodePNG(const u8* pixels,u32 width,u32 height,u8 colorType,std::vector<u8>& png,const EncoderOptions& options = EncoderOptions());
+
+#endif
@@ -5,489 +5,59 @@
 #include <cstring>
 #include <cstdint>
 #include <math.h>
-#include "HuffmanTree.h"
-#include "BitReader.h"
+#include <algorithm>
+#include <functional>
+#include "Parser.h"
 #include "Timer.h"
+#include "ThreadPool.h"
+#include "CachedDecoder.h"
+#include "Defilter.h"
+#include "StreamDecoder.h"
+#include "PNGEncoder.h"
+#include "OutOfCore.h"
+#include "APNGDecoder.h"
+#include "AsyncReader.h"
+#include "TensorOutput.h"
+#include "Thumbnail.h"
+#include <atomic>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 typedef unsigned int u32;
 typedef unsigned char u8;
 typedef unsigned short u16;
 
-struct Pixel{
-    u8 R;
-    u8 G;
-    u8 B;
-    u8 getChannel(u8 i){
-        if(i == 0){
-            return R;
-        }else if(i == 1){
-            return G;
-        }else if(i == 2){
-            return B;
-        }else{
-            return (u8)NULL;
-        }
-    }
-    void setChannel(u8 i,u8 value){
-        if(i == 0){
-            R = value;
-        }else if(i == 1){
-            G = value;
-        }else if(i == 2){
-            B = value;
-        }
-    }
-};
-
-struct ParsedData{
-    u32 width;
-    u32 height;
-    u8 bpp;
-    u8 colorType;
-    u8 compressionMethod;
-    u8 filterMethod;
-    u8 interlaceMethod;
-    std::vector<char> compressedData;
-    std::vector<u8> imageData;
-};
-
-char colorTypes[7][20] = {
-    "Grayscale",            // 0
-    "ERROR",
-    "Truecolor",            // 2
-    "Indexed",              // 3
-    "Grayscale and Alpha",  // 4
-    "ERROR",
-    "Truecolor and Alpha"   // 6
-};
-char compressionNames[3][16] = {
-    "No Compression",
-    "Fixed Huffman",
-    "Dynamic Huffman"
-};
-
-class Parser {
-public:
-    ~Parser() = default;
-
-    bool parse(const std::string& filepath, ParsedData& parsedData) {
-        bool result=true;
-        std::ifstream file(filepath, std::ios::binary | std::ios::ate);
-        if (!file) {
-            std::cerr << "Failed to open file " << filepath << "\n";
-            return false;
-        }
-        //Get size
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        //Copy png file into buffer
-        std::vector<char> buffer(size);
-        if (!file.read(buffer.data(), size)) {
-            std::cerr << "Failed to read from file\n";
-            return false;
-        }
-
-        //Check header
-        const unsigned char pngHeader[8] = {
-            0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
-        };
-        if (std::memcmp(buffer.data(), pngHeader, 8) != 0) {
-            std::cerr << "The provided file " << filepath << " is not a valid PNG file\n";
-            return false;
-        }
-
-        const char* reader = buffer.data() + 8;
-        const char* end = buffer.data() + size;
-
-        //Read until the last byte
-        while (reader + 8 <= end) {
-            uint32_t length = readLittleEndian32(reader);
-            reader += 4;
-
-            std::string chunkType(reader, 4);
-            reader += 4;
-
-            if (chunkType == "IHDR" && reader + 13 <= end) {
-                parsedData.width = readLittleEndian32(&reader[0]);
-                parsedData.height = readLittleEndian32(&reader[4]);
-                parsedData.bpp = static_cast<unsigned char>(reader[8]);
-                parsedData.colorType = static_cast<unsigned char>(reader[9]);
-                parsedData.compressionMethod = static_cast<unsigned char>(reader[10]);
-                parsedData.filterMethod = static_cast<unsigned char>(reader[11]);
-                parsedData.interlaceMethod = static_cast<unsigned char>(reader[12]);
-
-                bool supported = (
-                    (parsedData.bpp == 8) &&
-                    (parsedData.colorType == 2) &&
-                    (parsedData.filterMethod == 0) &&
-                    (parsedData.interlaceMethod == 0) &&
-                    (parsedData.compressionMethod == 0) 
-                );
-                if(!supported){
-                    bool bppSupported = (parsedData.bpp == 8);
-                    bool colorTypeSupported = (parsedData.colorType == 2);
-                    bool interlaceMethodSupported = (parsedData.interlaceMethod == 0);
-                    bool filterMethodSupported = (parsedData.filterMethod == 0);
-                    bool compressionMethodSupported = (parsedData.compressionMethod == 0);
-
-                    if(!bppSupported){
-                        std::cout << "The png file has unsupported bits per channel:"<<(int)parsedData.bpp<<"\n";
-                    }
-                    if(!colorTypeSupported){
-                        std::cout << "The png file has unsupported color type: "<<(int)parsedData.colorType << " (" << colorTypes[(int)parsedData.colorType] << ")\n";
-                    }
-                    if(!interlaceMethodSupported){
-                        std::cout << "The png file has unsupported interlace method:"<<(int)parsedData.interlaceMethod<<"\n";
-                    }
-                    if(!filterMethodSupported){
-                        std::cout << "The png file has unsupported filter method:"<<(int)parsedData.filterMethod<<"\n";
-                    }
-                    if(!compressionMethodSupported){
-                        std::cout << "The png file has unsupported compression method:"<<(int)parsedData.compressionMethod<<"\n";
-                    }
-                    std::cerr<<"PNG file is not supported\n";
-                    //return false;
-                }
-            }
-            else if (chunkType == "IDAT") {
-                parsedData.compressedData.insert(parsedData.compressedData.end(), reader, reader + length);
-            }else if (chunkType == "IEND"){
-                if(!decompressData(parsedData)){
-                    result = false;
-                }
-            }else{
-                std::cout << "Unhandled Chunktype "<<chunkType<<" Encountered\n";
-            }
-
-            reader += length + 4; // skip data and CRC
-        }
-        
-        return result;
-    }
-
-    std::string byteAsBin(char value){
-        std::string result = "";
-        for (int i=7;i>-1;i--){
-            int mask = pow(2,i);
-            result += std::to_string(((value & mask) != 0));
-        }
-        return result;
-    }
-
-    std::string bitsAsBin(u32 bits){
-        char bytes[4];
-        bytes[0] = (static_cast<u8>(bits >> 24));
-        bytes[1] = (static_cast<u8>(bits >> 16));
-        bytes[2] = (static_cast<u8>(bits >> 8));
-        bytes[3] = (static_cast<u8>(bits));
-
-        std::string res[4];
-        res[0] = byteAsBin(bytes[0]);
-        res[1] = byteAsBin(bytes[1]);
-        res[2] = byteAsBin(bytes[2]);
-        res[3] = byteAsBin(bytes[3]);
-
-        std::string result = res[0] + ' ' + res[1] + ' ' + res[2] + ' ' + res[3];
-
-        return result;
-    }
-
-    bool decompressData(ParsedData& parsedData){
-        //Block compression types
-        enum BlockType{
-            BTYPE_NO_COMPRESSION=0,
-            BTYPE_FIXED_HUFFMAN,
-            BTYPE_DYNAMIC_HUFFMAN,
-            BTYPE_RESERVED
-        };
-        const char* reader = parsedData.compressedData.data();
-        const char* end = parsedData.compressedData.data() + parsedData.compressedData.size();
-        //skip zlib header CMF
-        reader += 1;
-
-        bool DICTexists = ((*reader & 32) != 0); //*reader & 00100000
-        //Skip FLG
-        reader += 1;
-        if(DICTexists){
-            //skip DICT ADLER32
-            reader += 4;
-        }
-        std::cout << "Compressed data size: "<<parsedData.compressedData.size()<<" Bytes \n";
-        
-        BitReader bitReader((u8*)reader);
-        while((bitReader.reader + 8) <= (u8*)end){
-            //Block header
-            bool lastblockbit = bitReader.readBit();
-            u32 compressionType = bitReader.readBitsLE(2);
-            u16 blockLength = 0;
-            if(compressionType == BTYPE_NO_COMPRESSION){
-                //std::cout <<"Deflate block : BTYPE_NO_COMPRESSION\n";
-                //skip header
-                bitReader.skipCurByte(1);
-                //Read LEN(2B)
-                blockLength = bitReader.readBitsLE(16);
-                //std::cout<<"Block length : "<<blockLength<<"\n";
-                //Read NLEN(2B)
-                u16 nlen = bitReader.readBitsLE(16);
-                //check validity
-                if(u16((blockLength | nlen) + 1u) != 0){
-                    std::cerr << "LEN NLEN do not match\n";
-                    std::cerr << "PNG file is corrupt\n";
-                    return false;
-                }
-                parsedData.imageData.insert(parsedData.imageData.end(),(u8*)bitReader.reader,(u8*)bitReader.reader+blockLength);
-                //skip data
-                bitReader.skipCurByte(blockLength);
-            }else if(compressionType == BTYPE_FIXED_HUFFMAN){
-                std::cout <<"Deflate block : BTYPE_FIXED_HUFFMAN\n";
-                static HuffmanTree tree;
-                bool endOfBlock = false;
-                tree.initializeStaticDeflateTree();
-                while(!endOfBlock){
-                    u32 symbol = 0;
-                    u32 code = 0;
-                    for(int i=7;i<=9;i++){
-                        code = bitReader.peekBits(i);
-                        
-                        //lookup code from tree
-                        if((code >= tree.firstCode[i]) && (code < (tree.firstCode[i] + tree.ncodes[i]))){
-                            u32 index = tree.firstSymbol[i] + (code - tree.firstCode[i]);
-                            symbol = tree.symbols[index];
-                            bitReader.skipBits(i);
-                            break;
-                        }
-
-                        if(i==9){
-                            std::cout << bitsAsBin(code);
-                            std::cout << "No codes matched the tree (THIS SHOULD NOT HAPPEN)\n";
-                            return false;
-                        }
-                    }
-                    if(symbol < 256){
-                        //std::cout << "code: " << bitsAsBin(code) << "\n";
-                        std::cout << "literal: "<<symbol<<"\n";
-                        parsedData.imageData.push_back((u8)symbol);
-                    }
-                    else if(symbol == 256){
-                        endOfBlock = true;
-                    }else{
-                        u32 length=0;
-                        if(symbol < 265){
-                            length = symbol - 254;
-                        }else if(symbol == 285){
-                            length = 258;
-                        }else if(symbol < 285){
-                            BitRange range = tree.symbolRangeMap[symbol];
-                            u32 extraBits = range.bitCount;
-                            u32 offset = bitReader.readBitsLE(extraBits);
-                            length = range.min + offset;
-                        }else{
-                            length = 0;
-                            std::cerr << "Invalid bit\n";
-                            return false;
-                        }
-                        
-                        u32 distanceCode = bitReader.readBits(5);
-                        if(distanceCode > 29){
-                            //std::cerr << "Code: "<< code <<"\n";
-                            std::cerr << "Invalid distance code: "<<distanceCode<<"\n";
-                            return false;
-                        }
-                        BitRange range = tree.symbolRangeMap[distanceCode];
-                        u32 extraBits = range.bitCount;
-                        u32 offset = extraBits?bitReader.readBitsLE(extraBits):0;
-                        u32 distance = range.min + offset;
-                        if(length > distance){
-                            std::cerr << "Invalid Length: "<<length<<" (Length cant be more than distance)\n";
-                            return false;
-                        }
-                        std::cout << "pair: <" << length << ',' << distance << ">\n";
-                        for(int i=0;i<length;i++){
-                            parsedData.imageData.push_back((0u));
-                        }
-                    }
-
-                }
-                std::cout << "Byte Offset : "<< bitReader.bytesPushed << "\n";
-                std::cout << "Bit Offset : "<< (int)bitReader.bitOffset << "\n";
-
-            }else if(compressionType == BTYPE_DYNAMIC_HUFFMAN){
-                std::cout <<"Unhandled Deflate block:BTYPE_DYNAMIC_HUFFMAN\n";
-                u32 hLit = bitReader.readBitsLE(5) ;
-                u32 hDist = bitReader.readBitsLE(5);
-                u32 hClen = bitReader.readBitsLE(4);
-                
-                //Code Length's Lengths
-                u32 cll[19] = {0};
-                for(u32 i=0;i<=(hClen+4);i++){
-                    cll[i] = bitReader.readBitsLE(3);
-                }
-                HuffmanTree clTree;
-                u32 symbols[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
-                clTree.setCodeLengths(symbols,cll,19);
-                
-                std::vector<u32> literalLengthCodeLength;
-                literalLengthCodeLength.reserve(hLit+257);
-                for(u32 i=0;i<(hLit+257);i++){
-                    u32 bitCount = 0;
-                    //get encoded literal/length's code lengths
-                    u32 code = clTree.decode(bitReader,bitCount);
-                    if(code == 0xffffffff)return false;
-                    bitReader.skipBits(bitCount);
-
-                    if(code <= 15){
-                        literalLengthCodeLength.push_back(code);
-                    }else if(code == 16){
-                        u32 repeatLength = bitReader.readBitsLE(2);
-                        u32 prevSymbol = literalLengthCodeLength.at(literalLengthCodeLength.size()-1);
-                        for(u32 i=0;i<(repeatLength+3);i++){
-                            literalLengthCodeLength.push_back(prevSymbol);
-                        }
-                    }else if(code == 17){
-                        u32 repeatLength = bitReader.readBitsLE(3);
-                        for(u32 i=0;i<(repeatLength+3);i++){
-                            literalLengthCodeLength.push_back(0);
-                        }
-                    }else if(code == 18){
-                        u32 repeatLength = bitReader.readBitsLE(7);
-                        for(u32 i=0;i<(repeatLength+11);i++){
-                            literalLengthCodeLength.push_back(0);
-                        }
-                    }
-                }
-                
-                std::cout << "LiteralLengthCodeSize: " << literalLengthCodeLength.size()<<"\n";
-                HuffmanTree literalLengthTree;
-                std::vector<u32> literalSymbols;
-                literalSymbols.reserve(literalLengthCodeLength.size());
-                for(int i=0;i<literalLengthCodeLength.size();i++)literalSymbols.push_back(i);
-                literalLengthTree.setCodeLengths(literalSymbols.data(),literalLengthCodeLength.data(),literalLengthCodeLength.size());
-                // for(int i=0;i<literalLengthCodeLength.size();i++){
-                //     std::cout << "literal i: "<< i << " value: "<< literalLengthCodeLength.at(i) << "\n";
-                // }
-
-                for(u32 i=0;i<(hDist+1);i++){
-                    u32 bitCount = 0;
-                    //get encoded distance code lengths
-                    u32 code = clTree.decode(bitReader,bitCount);
-                    if(code == 0xffffffff)return false;
-                    bitReader.skipBits(bitCount);
-                }
-
-                std::cout << "HLIT: "<<hLit<<"\n";
-                std::cout << "HDIST: "<<hDist<<"\n";
-                std::cout << "HCLEN: "<<hClen<<"\n";
-                return false;
-            }else{
-                std::cout << "ERROR : INVALID COMPRESSION TYPE\n";
-                return false;
-            }
-            if(lastblockbit)std::cout << "(Last Block)\n";
-        }
-        
-        return true;
+//The filtered buffer needs a filter byte + width*pixelBytes bytes for every scanline
+bool isValidFilteredBuffer(const u8* buffer,size_t bufferSize,u32 width,u32 height,u32 pixelBytes){
+    uint64_t needed = ((uint64_t)width*pixelBytes + 1)*height;
+    if(!buffer || bufferSize < needed){
+        std::cerr << "Invalid buffer provided (" << bufferSize << " Bytes, " << needed << " Bytes needed)\n";
+        return false;
     }
-    
-    private:
-    //Little endian
-    static u32 readLittleEndian32(const char* data) {
-        return (static_cast<unsigned char>(data[0]) << 24) |
-        (static_cast<unsigned char>(data[1]) << 16) |
-        (static_cast<unsigned char>(data[2]) << 8)  |
-        (static_cast<unsigned char>(data[3]));
-    }
-    static u16 readLittleEndian16(const char* data){
-        return (static_cast<u16>(data[0]) << 8)|
-        (static_cast<u16>(data[1]));    
-    }
-    //Big endian
-    static u32 readBigEndian32(const char* data) {
-        return (static_cast<unsigned char>(data[0])) |
-        (static_cast<unsigned char>(data[1]) << 8) |
-        (static_cast<unsigned char>(data[2]) << 16)  |
-        (static_cast<unsigned char>(data[3]) << 24);
-    }
-    static u16 readBigEndian16(const char* data) {
-        return (static_cast<unsigned char>(data[0])) |
-        (static_cast<unsigned char>(data[1]) << 8);
-    }
-};
-
-u32 paethPredictor(u8 a,u8 b,u8 c){
-    u32 pr = 0;
-    int p = a + b - c;
-    u32 pa = abs(p - a);
-    u32 pb = abs(p - b);
-    u32 pc = abs(p - c);
-    if(pa <= pb && pa <= pc)pr = a;
-    else if(pb <= pc)pr = b;
-    else pr = c;
-
-    return pr;
+    return true;
 }
 
-const u8* createDefilteredBuffer(const u8* buffer,u32 width,u32 height){
+const u8* createDefilteredBuffer(const u8* buffer,size_t bufferSize,u32 width,u32 height,u32 pixelBytes){
     const u8* reader = buffer;
-    if(!(reader + (sizeof(u8)*width*height*3))){
-        std::cerr << "Invalid buffer provided\n";
+    if(!isValidFilteredBuffer(buffer,bufferSize,width,height,pixelBytes)){
+        return nullptr;
+    }
+    const size_t rowBytes = (size_t)width*pixelBytes;
+    u8* returnBuffer = (u8*)malloc(sizeof(u8)*rowBytes*height);
+    if(!returnBuffer){
+        std::cerr << "Failed to allocate the rgb buffer\n";
         return nullptr;
     }
-    u8* returnBuffer = (u8*)malloc(sizeof(u8)*(width*height*3));
     u8* writer = returnBuffer;
-    Pixel prevPixel = {0,0,0};
-    std::vector<Pixel> prevScanline(width,{0,0,0});
-    //Per scanline
+    //Per scanline, the previous scanline is read back from the output
     for(u32 y=0;y<height;y++){
-        int filterType = u32(reader[0]);
-        std::vector<Pixel> currentScanline(width,{0,0,0});
+        u8 filterType = reader[0];
         //skip filter byte
         reader += 1;
-        prevPixel = {0,0,0};
-         /*
-               c       b
-            |R|G|B| |R|G|B|
-               a       x
-            |R|G|B| |R|G|B| -> Current Pixel
-
-            filtering types
-
-            defiltering:
-            0 = none    : reconstructed x[channel] = filtered x[channel]
-            1 = sub     : reconstructed x[channel] = filtered x[channel] + filtered a[channel]
-            2 = up      : reconstructed x[channel] = filtered x[channel] + filtered b[channel]
-            3 = average : reconstructed x[channel] = filtered x[channel] + floor((filtered a[channel] + filtered b[channel]) / 2)
-            4 = paeth   : reconstructed x[channel] = filtered x[channel] + paeth(a,b,c)
-        */
-        //Per Pixel
-        for(u32 x=0;x<width;x++){
-            Pixel curPixel = {0,0,0};
-            //Per channel
-            for(u32 i=0;i<3;i++){
-                u8 value= reader?reader[i]:0;
-                u8 a = (x>0?prevPixel.getChannel(i):0);
-                u8 b = (y>0?prevScanline[x].getChannel(i):0);
-                u8 c = (x>0?prevScanline[x-1].getChannel(i):0);
-                if(filterType == 1){
-                    value = value + a;
-                }else if(filterType == 2){
-                    value = value + b;
-                }else if(filterType == 3){
-                    value = value + floor((a + b)/ 2.f);
-                }else if(filterType == 4){
-                    value = value + paethPredictor(a,b,c);
-                }else{
-                    value = value;
-                }
-                curPixel.setChannel(i,value);
-                writer[i] = curPixel.getChannel(i);
-            }
-            prevPixel = curPixel;
-            currentScanline[x] = curPixel;
-            reader+=3;
-            writer+=3;
-        }
-        prevScanline = currentScanline;
+        defilterScanline(reader,filterType,(y>0?writer-rowBytes:nullptr),writer,rowBytes,pixelBytes);
+        reader += rowBytes;
+        writer += rowBytes;
     }
     return returnBuffer;
 }
@@ -496,16 +66,13 @@ void deleteBuffer(const u8* buffer){
     free((void*)buffer);
 }
 
-void defilterAndOutput(const u8* buffer,u32 width,u32 height){
-    //Get Defiltered Buffer
-    const u8* rgbBuffer = createDefilteredBuffer(buffer,width,height);
-
-    //Output Image to ppm
+//Outputs an rgb (or rgba, alpha is dropped) buffer as a plain text ppm
+bool writePPM(const std::string& filepath,const u8* rgbBuffer,u32 width,u32 height,u32 pixelBytes = 3){
     std::ofstream ofs;
-    ofs.open("imageoutput.ppm");
+    ofs.open(filepath);
     if(!ofs.is_open()){
-        std::cout << "Failed to open imageoutput.ppm\n";
-        return;
+        std::cout << "Failed to open " << filepath << "\n";
+        return false;
     }
     const u8* reader = rgbBuffer;
     ofs << "P3\n" << width << " " <<  height <<"\n255\n";   
@@ -517,17 +84,573 @@ void defilterAndOutput(const u8* buffer,u32 width,u32 height){
             for(u32 i=0;i<3;i++){
                 ofs << u32(reader[i]) << (i==2?"":" ");
             }
-            reader += 3;
+            reader += pixelBytes;
             ofs << '\n';
         }
     }
-    
-    deleteBuffer(rgbBuffer);
     ofs.close();
+    return true;
+}
+
+void defilterAndOutput(const u8* buffer,size_t bufferSize,u32 width,u32 height,u32 pixelBytes){
+    //Get Defiltered Buffer
+    const u8* rgbBuffer = createDefilteredBuffer(buffer,bufferSize,width,height,pixelBytes);
+    if(!rgbBuffer)return;
+
+    //Output Image to ppm
+    writePPM("imageoutput.ppm",rgbBuffer,width,height,pixelBytes);
+    deleteBuffer(rgbBuffer);
+}
+
+//Decodes the file and writes a thumbnail whose longest side is maxSize pixels to thumbnail.ppm
+int outputThumbnail(const std::string& filepath,u32 maxSize,ColorOutput colorOutput = COLOR_AS_IS){
+    Parser parser;
+    std::vector<char> buffer;
+    if(!parser.readFile(filepath,buffer)){
+        return 1;
+    }
+    Timer timer;
+    Thumbnail thumbnail;
+    if(!createThumbnail((const u8*)buffer.data(),buffer.size(),maxSize,thumbnail,colorOutput)){
+        std::cerr << "Failed to parse the PNG\n";
+        return 1;
+    }
+    timer.stop();
+    std::cout << "Thumbnail " << thumbnail.width << "x" << thumbnail.height << " took:" << timer.dtms << "ms\n";
+    return writePPM("thumbnail.ppm",thumbnail.pixels.data(),thumbnail.width,thumbnail.height) ? 0 : 1;
+}
+
+//Prints width, height, bit depth and color type of every file without decoding them
+int probeFiles(int argc,char* argv[]) {
+    std::vector<std::string> filepaths;
+    for(int i=2;i<argc;i++){
+        filepaths.push_back(argv[i]);
+    }
+    Parser parser;
+    std::vector<ParsedData> results;
+    std::vector<bool> succeeded;
+    Timer timer;
+    u32 probed = parser.probeBatch(filepaths, results, succeeded);
+    timer.stop();
+    for(size_t i=0;i<filepaths.size();i++){
+        if(!succeeded[i])continue;
+        const ParsedData& info = results[i];
+        const char* colorName = info.colorType < 7 ? colorTypes[info.colorType] : "ERROR";
+        std::cout << filepaths[i] << ": " << info.width << "x" << info.height
+                  << " " << (int)info.bpp << "-bit " << colorName << "\n";
+    }
+    double filesPerSecond = timer.dtms > 0 ? (filepaths.size() / (timer.dtms / 1000.0)) : 0;
+    std::cout << "Probed " << probed << "/" << filepaths.size() << " files in " << timer.dtms << "ms ("
+              << filesPerSecond << " files/s)\n";
+    return probed == filepaths.size() ? 0 : 1;
+}
+
+void printHuffmanCacheStats(){
+    HuffmanCacheStats stats = HuffmanTableCache::shared().getStats();
+    std::cout << "Huffman table cache hits: " << stats.hits << " misses: " << stats.misses << " (hit rate " << stats.hitRate()*100.0
+              << "%) collisions: " << stats.collisions << " building took: " << stats.buildMilliseconds << "ms saved: " << stats.savedMilliseconds << "ms\n";
+}
+
+//Prints what the color chunks say and which curve the samples are decoded with
+void printColorProfile(const ColorProfile& profile){
+    TransferKind kind;
+    double exponent;
+    profile.getTransfer(kind,exponent);
+    if(profile.hasSRGB){
+        std::cout << "sRGB chunk, rendering intent " << (int)profile.renderingIntent << "\n";
+    }
+    if(profile.hasICC){
+        std::cout << "ICC profile \"" << profile.iccName << "\"" << (profile.iccTransferFound ? "" : " (transfer curve is not a plain gamma)") << "\n";
+    }
+    if(profile.hasGamma){
+        std::cout << "gAMA " << profile.gamma/100000.0 << "\n";
+    }
+    if(profile.hasChromaticities){
+        std::cout << "cHRM white " << profile.chromaticities[0]/100000.0 << "," << profile.chromaticities[1]/100000.0 << "\n";
+    }
+    if(kind == TRANSFER_SRGB){
+        std::cout << "Samples are sRGB encoded" << (profile.hasSRGB || profile.hasICC || profile.hasGamma ? "" : " (untagged)") << "\n";
+    }else{
+        std::cout << "Samples are gamma " << exponent << " encoded\n";
+    }
+}
+
+//Feeds the file to a StreamDecoder in sliceSize pieces, scanlines are written to imageoutput.ppm as they complete
+int streamDecodeFile(const std::string& filepath,size_t sliceSize,ColorOutput colorOutput = COLOR_AS_IS){
+    std::ifstream file(filepath, std::ios::binary);
+    if(!file){
+        std::cerr << "Failed to open file " << filepath << "\n";
+        return 1;
+    }
+    std::ofstream ofs("imageoutput.ppm");
+    if(!ofs.is_open()){
+        std::cout << "Failed to open imageoutput.ppm\n";
+        return 1;
+    }
+    //the build times are printed at the end
+    HuffmanTableCache::shared().setTiming(true);
+    Timer timer;
+    u32 pixelBytes = 0;
+    u32 width = 0;
+    StreamDecoder decoder(
+        [&](const ImageHeader& header){
+            pixelBytes = header.colorType == 6 ? 4 : 3;
+            width = header.width;
+            ofs << "P3\n" << header.width << " " << header.height << "\n255\n";
+        },
+        [&](u32,const u8* row){
+            //alpha is dropped
+            for(u32 x=0;x<width;x++){
+                const u8* pixel = row + x*pixelBytes;
+                ofs << u32(pixel[0]) << " " << u32(pixel[1]) << " " << u32(pixel[2]) << '\n';
+            }
+        }
+    );
+    decoder.setColorOutput(colorOutput);
+    std::vector<char> slice(sliceSize);
+    while(file){
+        file.read(slice.data(),slice.size());
+        std::streamsize count = file.gcount();
+        if(count <= 0)break;
+        if(!decoder.feed((const u8*)slice.data(),(size_t)count)){
+            std::cerr << "Failed to parse the PNG\n";
+            return 1;
+        }
+    }
+    if(!decoder.finished()){
+        std::cerr << "The PNG file ended early\n";
+        return 1;
+    }
+    timer.stop();
+    std::cout << "Streaming decode took:" << timer.dtms << "ms\n";
+    if(colorOutput != COLOR_AS_IS){
+        printColorProfile(decoder.getColorProfile());
+    }
+    printHuffmanCacheStats();
+    return 0;
+}
+
+//Out of core decode, prints the time and the peak resident memory
+int outOfCoreFile(const std::string& inputPath,const std::string& outputPath,bool mapped){
+    Timer timer;
+    if(!decodeToFile(inputPath,outputPath,mapped,DecodeLimits())){
+        return 1;
+    }
+    timer.stop();
+    std::cout << "Out of core decode took:" << timer.dtms << "ms\n";
+#ifndef _WIN32
+    rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    std::cout << "Peak resident memory: " << usage.ru_maxrss << " KiB\n";
+#endif
+    return 0;
+}
+
+//Decodes every frame of an animated png (or only frame index) and writes the last decoded canvas to imageoutput.ppm
+int decodeAnimation(const std::string& filepath,bool singleFrame,u32 index){
+    Parser parser;
+    std::vector<char> buffer;
+    if(!parser.readFile(filepath,buffer)){
+        return 1;
+    }
+    Timer indexTimer;
+    APNGDecoder decoder;
+    if(!decoder.open((const u8*)buffer.data(),buffer.size())){
+        return 1;
+    }
+    indexTimer.stop();
+    const ImageHeader& header = decoder.getHeader();
+    std::cout << header.width << "x" << header.height << ", " << decoder.getFrameCount() << " frames, "
+              << decoder.getPlayCount() << " plays (indexed in " << indexTimer.dtms << "ms)\n";
+
+    std::vector<u8> canvas;
+    Timer timer;
+    if(singleFrame){
+        if(!decoder.decodeFrame(index,canvas)){
+            return 1;
+        }
+        timer.stop();
+        std::cout << "Frame " << index << " (key frame " << decoder.getFrame(index).keyFrame << ") took:" << timer.dtms << "ms\n";
+    }else{
+        //only the last canvas is written
+        if(!decoder.decodeAll([&canvas](u32,const std::vector<u8>& frameCanvas){ canvas = frameCanvas; })){
+            return 1;
+        }
+        timer.stop();
+        std::cout << "Decoding " << decoder.getFrameCount() << " frames took:" << timer.dtms << "ms\n";
+    }
+    //alpha is dropped
+    std::vector<u8> rgb((size_t)header.width*header.height*3);
+    for(size_t i=0;i<(size_t)header.width*header.height;i++){
+        rgb[i*3+0] = canvas[i*4+0];
+        rgb[i*3+1] = canvas[i*4+1];
+        rgb[i*3+2] = canvas[i*4+2];
+    }
+    return writePPM("imageoutput.ppm",rgb.data(),header.width,header.height) ? 0 : 1;
+}
+
+//Re-encodes a png with the native encoder and checks that it decodes back to the same pixels
+int encodeFile(const std::string& inputPath,const std::string& outputPath,u32 threadCount){
+    Parser parser;
+    std::vector<char> input;
+    if(!parser.readFile(inputPath,input)){
+        return 1;
+    }
+    std::vector<u8> pixels;
+    ImageHeader header;
+    if(!decodePixels((const u8*)input.data(),input.size(),pixels,header)){
+        std::cerr << "Failed to parse the PNG\n";
+        return 1;
+    }
+
+    EncoderOptions options;
+    options.threadCount = threadCount;
+    std::vector<u8> png;
+    Timer timer;
+    if(!encodePNG(pixels.data(),header.width,header.height,header.colorType,png,options)){
+        return 1;
+    }
+    timer.stop();
+    std::cout << "Encoding took:" << timer.dtms << "ms (" << input.size() << " -> " << png.size() << " Bytes)\n";
+
+    std::ofstream ofs(outputPath,std::ios::binary);
+    if(!ofs.write((const char*)png.data(),png.size())){
+        std::cerr << "Failed to write " << outputPath << "\n";
+        return 1;
+    }
+
+    std::vector<u8> roundTrip;
+    ImageHeader roundTripHeader;
+    if(!decodePixels(png.data(),png.size(),roundTrip,roundTripHeader) || roundTrip != pixels){
+        std::cerr << "Round trip through the decoder does not match\n";
+        return 1;
+    }
+    std::cout << "Round trip OK\n";
+    return 0;
+}
+
+//Decodes the files on the batch pool through an ImageCache and prints the cache counters
+int decodeFiles(const std::vector<std::string>& filepaths,ColorOutput colorOutput) {
+    //256MiB in memory, evicted images spill to .pngcache which is kept under 1GiB
+    ImageCache cache((size_t)256 << 20,".pngcache",(u64)1 << 30);
+    Timer timer;
+    CachedDecodeOptions options;
+    options.colorOutput = colorOutput;
+    u32 decoded = decodeBatch(filepaths,cache,nullptr,0,options);
+    timer.stop();
+    CacheStats stats = cache.getStats();
+    std::cout << "Decoded " << decoded << "/" << filepaths.size() << " files in " << timer.dtms << "ms\n";
+    std::cout << "Cache hits: " << stats.hits << " spill hits: " << stats.spillHits << " misses: " << stats.misses
+              << " collisions: " << stats.collisions << " evictions: " << stats.evictions << " spills: " << stats.spills << " bytes used: " << stats.bytesUsed << "\n";
+    std::cout << "Spill directory: " << stats.spillBytesUsed << " bytes, " << stats.spillRemovals << " blobs removed\n";
+    return decoded == filepaths.size() ? 0 : 1;
+}
+
+void printUsage(){
+    std::cerr << "Usage:\n"
+              << "  PNGLoader [file.png]\n"
+              << "  PNGLoader --probe <files...>\n"
+              << "  PNGLoader --thumbnail <size> file.png [linear|srgb]\n"
+              << "  PNGLoader --batch [--color <linear|srgb>] <files...>\n"
+              << "  PNGLoader --stream file.png [sliceSize]\n"
+              << "  PNGLoader --encode in.png out.png [threads]\n"
+              << "  PNGLoader --out-of-core in.png out.ppm [--mmap]\n"
+              << "  PNGLoader --apng file.png [frame]\n"
+              << "  PNGLoader --ingest [--depth N] [--threads N] [--pread] [--blocking] [--cold] [--no-table-cache] <files...>\n"
+              << "  PNGLoader --tensor file.png [planar] [f32|f16] [rgba|premultiplied] [normalize] [linear|srgb]\n"
+              << "  PNGLoader --color <linear|srgb> file.png\n";
+}
+
+//"linear" or "srgb", false for anything else
+bool parseColorOutput(const std::string& text,ColorOutput& output){
+    if(text == "linear"){
+        output = COLOR_LINEAR;
+        return true;
+    }
+    if(text == "srgb"){
+        output = COLOR_SRGB;
+        return true;
+    }
+    return false;
+}
+
+//Reads a plain decimal number, false for signs, trailing characters or anything above u32
+bool parseNumber(const char* text,u32& value){
+    if(!text || *text < '0' || *text > '9'){
+        return false;
+    }
+    uint64_t result = 0;
+    for(const char* reader = text;*reader;reader++){
+        if(*reader < '0' || *reader > '9'){
+            return false;
+        }
+        result = result*10 + (u32)(*reader - '0');
+        if(result > 0xffffffffull){
+            return false;
+        }
+    }
+    value = (u32)result;
+    return true;
+}
+
+/*
+    Batch ingest benchmark. Files are read by AsyncFileReader (io_uring or preads) with up to
+    depth reads in flight, every completed buffer goes straight to a decode job on the pool
+    and the job gives the buffer back to the BufferPool when it is done.
+    --blocking reads inside the decode jobs instead, --cold drops the files from the page cache first,
+    --no-table-cache builds the huffman trees of every dynamic block.
+    Prints how much of the time the decode threads spent decoding.
+*/
+int ingestFiles(int argc,char* argv[]){
+    u32 queueDepth = 32;
+    u32 threadCount = 0;
+    bool allowIoUring = true;
+    bool cold = false;
+    bool blocking = false;
+    std::vector<std::string> filepaths;
+    for(int i=2;i<argc;i++){
+        std::string arg = argv[i];
+        if(arg == "--depth" || arg == "--threads"){
+            u32 value = 0;
+            if(i + 1 >= argc || !parseNumber(argv[++i],value)){
+                std::cerr << arg << " needs a number\n";
+                printUsage();
+                return 1;
+            }
+            (arg == "--depth" ? queueDepth : threadCount) = value;
+        }else if(arg == "--pread"){
+            allowIoUring = false;
+        }else if(arg == "--cold"){
+            cold = true;
+        }else if(arg == "--blocking"){
+            blocking = true;
+        }else if(arg == "--no-table-cache"){
+            HuffmanTableCache::shared().setCapacity(0);
+        }else{
+            filepaths.push_back(arg);
+        }
+    }
+    HuffmanTableCache::shared().setTiming(true);
+    if(cold){
+        u32 evicted = 0;
+        for(const std::string& filepath : filepaths){
+            evicted += evictFromPageCache(filepath) ? 1 : 0;
+        }
+        std::cout << "Dropped " << evicted << "/" << filepaths.size() << " files from the page cache\n";
+    }
+
+    ThreadPool decoders(threadCount);
+    std::atomic<u64> busyMicroseconds(0);
+    std::atomic<u64> bytesRead(0);
+    std::atomic<u32> decoded(0);
+    auto decode = [&](const std::vector<char>& buffer){
+        Timer decodeTimer;
+        thread_local std::vector<u8> pixels;
+        ImageHeader header;
+        if(decodePixels((const u8*)buffer.data(),buffer.size(),pixels,header)){
+            decoded++;
+        }
+        decodeTimer.stop();
+        busyMicroseconds += (u64)(decodeTimer.dtms*1000.0);
+        bytesRead += buffer.size();
+    };
+
+    Timer timer;
+    if(blocking){
+        for(const std::string& filepath : filepaths){
+            decoders.enqueue([&decode,&filepath](){
+                Parser parser;
+                thread_local std::vector<char> buffer;
+                if(parser.readFile(filepath,buffer)){
+                    decode(buffer);
+                }
+            });
+        }
+        decoders.wait();
+        std::cout << "Reading inside the decode jobs\n";
+    }else{
+        //enough buffers for every read in flight plus a couple queued per decoder
+        BufferPool pool(queueDepth + decoders.size()*2);
+        AsyncFileReader reader(pool,queueDepth,allowIoUring);
+        reader.readFiles(filepaths,[&](size_t,std::vector<char>* buffer){
+            if(!buffer)return;
+            decoders.enqueue([&decode,&pool,buffer](){
+                decode(*buffer);
+                pool.release(buffer);
+            });
+        });
+        decoders.wait();
+        std::cout << "Reading with " << (reader.usingIoUring() ? "io_uring" : "preads") << ", queue depth " << queueDepth << "\n";
+    }
+    timer.stop();
+
+    double busy = busyMicroseconds / 1000.0;
+    double utilization = timer.dtms > 0 ? 100.0*busy/(timer.dtms*decoders.size()) : 0;
+    double megabytesPerSecond = timer.dtms > 0 ? (bytesRead / (1024.0*1024.0)) / (timer.dtms / 1000.0) : 0;
+    std::cout << "Decoded " << decoded << "/" << filepaths.size() << " files in " << timer.dtms << "ms ("
+              << megabytesPerSecond << " MiB/s)\n";
+    std::cout << "Decode threads busy: " << utilization << "% of " << decoders.size() << " threads\n";
+    printHuffmanCacheStats();
+    return decoded == filepaths.size() ? 0 : 1;
+}
+
+/*
+    Decodes into a tensor of the format given by the keywords (planar, f32, f16, rgba, premultiplied, normalize)
+    and writes it raw to tensor.bin. The fused decode is timed against decoding first and converting after.
+*/
+int tensorFile(int argc,char* argv[]){
+    std::string filepath = argv[2];
+    TensorFormat format;
+    for(int i=3;i<argc;i++){
+        std::string arg = argv[i];
+        if(arg == "planar"){
+            format.layout = TENSOR_PLANAR;
+        }else if(arg == "f32"){
+            format.type = TENSOR_F32;
+        }else if(arg == "f16"){
+            format.type = TENSOR_F16;
+        }else if(arg == "rgba"){
+            format.channels = 4;
+        }else if(arg == "premultiplied"){
+            format.channels = 4;
+            format.premultiply = true;
+        }else if(arg == "normalize"){
+            //imagenet mean and std
+            const float mean[3] = {0.485f,0.456f,0.406f};
+            const float std[3] = {0.229f,0.224f,0.225f};
+            format.setNormalization(mean,std);
+        }else if(!parseColorOutput(arg,format.color)){
+            printUsage();
+            return 1;
+        }
+    }
+    if(format.type != TENSOR_U8 && format.scale[0] == 1.0f){
+        //plain 0-1 floats
+        for(u32 c=0;c<4;c++){
+            format.scale[c] = 1.0f/255.0f;
+        }
+    }
+    Parser parser;
+    std::vector<char> buffer;
+    ParsedData info;
+    if(!parser.probe(filepath,info) || !parser.readFile(filepath,buffer)){
+        return 1;
+    }
+    size_t bytes = tensorBytes(format,info.width,info.height);
+    std::unique_ptr<u8[],void(*)(u8*)> tensor = allocateTensor(bytes);
+    if(!tensor){
+        std::cerr << "Failed to allocate " << bytes << " bytes\n";
+        return 1;
+    }
+
+    ImageHeader header;
+    Timer fusedTimer;
+    if(!decodeToTensor((const u8*)buffer.data(),buffer.size(),format,tensor.get(),bytes,header)){
+        return 1;
+    }
+    fusedTimer.stop();
+
+    Timer separateTimer;
+    std::vector<u8> pixels;
+    std::unique_ptr<u8[],void(*)(u8*)> separate = allocateTensor(bytes);
+    if(!separate){
+        std::cerr << "Failed to allocate " << bytes << " bytes\n";
+        return 1;
+    }
+    if(!decodePixels((const u8*)buffer.data(),buffer.size(),pixels,header,format.color)){
+        return 1;
+    }
+    u32 pixelBytes = header.colorType == 6 ? 4 : 3;
+    for(u32 y=0;y<header.height;y++){
+        writeTensorRow(pixels.data() + (size_t)y*header.width*pixelBytes,pixelBytes,y,header.width,header.height,format,separate.get());
+    }
+    separateTimer.stop();
+    if(std::memcmp(tensor.get(),separate.get(),bytes) != 0){
+        std::cerr << "Fused and separate tensors differ\n";
+        return 1;
+    }
+
+    std::ofstream ofs("tensor.bin",std::ios::binary);
+    ofs.write((const char*)tensor.get(),bytes);
+    std::cout << "Tensor " << header.width << "x" << header.height << "x" << format.channels << " (" << bytes << " Bytes)"
+              << " fused decode took:" << fusedTimer.dtms << "ms, decode then convert took:" << separateTimer.dtms << "ms\n";
+    return ofs ? 0 : 1;
 }
 
 int main(int argc,char* argv[]) {
 
+    if(argc >= 2 && std::string(argv[1]) == "--probe"){
+        return probeFiles(argc,argv);
+    }
+    if(argc >= 2 && std::string(argv[1]) == "--batch"){
+        ColorOutput output = COLOR_AS_IS;
+        int first = 2;
+        if(argc >= 3 && std::string(argv[2]) == "--color"){
+            if(argc < 4 || !parseColorOutput(argv[3],output)){
+                printUsage();
+                return 1;
+            }
+            first = 4;
+        }
+        return decodeFiles(std::vector<std::string>(argv + first,argv + argc),output);
+    }
+    if(argc >= 2 && std::string(argv[1]) == "--color"){
+        ColorOutput output = COLOR_AS_IS;
+        if(argc < 4 || !parseColorOutput(argv[2],output)){
+            printUsage();
+            return 1;
+        }
+        return streamDecodeFile(argv[3],65536,output);
+    }
+    if(argc >= 3 && std::string(argv[1]) == "--tensor"){
+        return tensorFile(argc,argv);
+    }
+    if(argc >= 3 && std::string(argv[1]) == "--ingest"){
+        return ingestFiles(argc,argv);
+    }
+    if(argc >= 3 && std::string(argv[1]) == "--stream"){
+        //optional slice size to simulate network sized pieces
+        u32 sliceSize = 65536;
+        if(argc >= 4 && !parseNumber(argv[3],sliceSize)){
+            printUsage();
+            return 1;
+        }
+        return streamDecodeFile(argv[2],std::max<size_t>(sliceSize,1));
+    }
+    if(argc >= 4 && std::string(argv[1]) == "--encode"){
+        u32 threadCount = 1;
+        if(argc >= 5 && !parseNumber(argv[4],threadCount)){
+            printUsage();
+            return 1;
+        }
+        return encodeFile(argv[2],argv[3],threadCount);
+    }
+    if(argc >= 3 && std::string(argv[1]) == "--apng"){
+        bool singleFrame = argc >= 4;
+        u32 frame = 0;
+        if(singleFrame && !parseNumber(argv[3],frame)){
+            printUsage();
+            return 1;
+        }
+        return decodeAnimation(argv[2],singleFrame,frame);
+    }
+    if(argc >= 4 && std::string(argv[1]) == "--out-of-core"){
+        bool mapped = argc >= 5 && std::string(argv[4]) == "--mmap";
+        return outOfCoreFile(argv[2],argv[3],mapped);
+    }
+    if(argc >= 4 && std::string(argv[1]) == "--thumbnail"){
+        u32 maxSize = 0;
+        if(!parseNumber(argv[2],maxSize) || maxSize == 0){
+            printUsage();
+            return 1;
+        }
+        ColorOutput output = COLOR_AS_IS;
+        if(argc >= 5 && !parseColorOutput(argv[4],output)){
+            printUsage();
+            return 1;
+        }
+        return outputThumbnail(argv[3],maxSize,output);
+    }
     const std::string filepath = argc<2?"res/test.png":argv[1];
     Parser parser;
     ParsedData parsedData;
@@ -549,7 +672,7 @@ int main(int argc,char* argv[]) {
         std::cerr << "Failed to parse the PNG\n";
         return 1;
     }
-    defilterAndOutput(parsedData.imageData.data(),parsedData.width,parsedData.height);
+    defilterAndOutput(parsedData.imageData.data(),parsedData.imageData.size(),parsedData.width,parsedData.height,parsedData.pixelBytes());
     timer.stop();
     std::cout << "Parsing took:" << timer.dtms << "ms\n";
     std::cout<<"Successfully parsed the png\n";
@@ -0,0 +1,232 @@
+#include "Parser.h"
+#include "Inflater.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+const char colorTypes[7][20] = {
+    "Grayscale",            // 0
+    "ERROR",
+    "Truecolor",            // 2
+    "Indexed",              // 3
+    "Grayscale and Alpha",  // 4
+    "ERROR",
+    "Truecolor and Alpha"   // 6
+};
+
+//Little endian
+static u32 readLittleEndian32(const char* data) {
+    return (static_cast<unsigned char>(data[0]) << 24) |
+    (static_cast<unsigned char>(data[1]) << 16) |
+    (static_cast<unsigned char>(data[2]) << 8)  |
+    (static_cast<unsigned char>(data[3]));
+}
+
+static void readIHDR(const char* data, ParsedData& parsedData) {
+    parsedData.width = readLittleEndian32(&data[0]);
+    parsedData.height = readLittleEndian32(&data[4]);
+    parsedData.bpp = static_cast<unsigned char>(data[8]);
+    parsedData.colorType = static_cast<unsigned char>(data[9]);
+    parsedData.compressionMethod = static_cast<unsigned char>(data[10]);
+    parsedData.filterMethod = static_cast<unsigned char>(data[11]);
+    parsedData.interlaceMethod = static_cast<unsigned char>(data[12]);
+}
+
+bool Parser::parse(const std::string& filepath, ParsedData& parsedData) {
+    std::vector<char> buffer;
+    if (!readFile(filepath, buffer)) {
+        return false;
+    }
+    return parseBuffer(buffer.data(), buffer.size(), parsedData);
+}
+
+//Copies the whole file into buffer
+bool Parser::readFile(const std::string& filepath, std::vector<char>& buffer) {
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Failed to open file " << filepath << "\n";
+        return false;
+    }
+    //Get size
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    //Copy png file into buffer
+    buffer.resize(size);
+    if (!file.read(buffer.data(), size)) {
+        std::cerr << "Failed to read from file\n";
+        return false;
+    }
+    return true;
+}
+
+//Parses a png that is already in memory
+bool Parser::parseBuffer(const char* data, size_t size, ParsedData& parsedData) {
+    bool result=true;
+
+    //Check header
+    const unsigned char pngHeader[8] = {
+        0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    if (size < 8 || std::memcmp(data, pngHeader, 8) != 0) {
+        std::cerr << "The provided data is not a valid PNG file\n";
+        return false;
+    }
+
+    const char* reader = data + 8;
+    const char* end = data + size;
+
+    //Read until the last byte
+    while (reader + 8 <= end) {
+        uint32_t length = readLittleEndian32(reader);
+        reader += 4;
+
+        std::string chunkType(reader, 4);
+        reader += 4;
+
+        //data + CRC must fit in what is left of the file
+        if (length > (size_t)(end - reader) || (size_t)(end - reader) - length < 4) {
+            std::cerr << "Chunk " << chunkType << " runs past the end of the file\n";
+            return false;
+        }
+
+        if (chunkType == "IHDR" && reader + 13 <= end) {
+            readIHDR(reader,parsedData);
+
+            bool supported = (
+                (parsedData.bpp == 8) &&
+                (parsedData.colorType == 2 || parsedData.colorType == 6) &&
+                (parsedData.filterMethod == 0) &&
+                (parsedData.interlaceMethod == 0) &&
+                (parsedData.compressionMethod == 0) 
+            );
+            if(!supported){
+                bool bppSupported = (parsedData.bpp == 8);
+                bool colorTypeSupported = (parsedData.colorType == 2 || parsedData.colorType == 6);
+                bool interlaceMethodSupported = (parsedData.interlaceMethod == 0);
+                bool filterMethodSupported = (parsedData.filterMethod == 0);
+                bool compressionMethodSupported = (parsedData.compressionMethod == 0);
+
+                if(!bppSupported){
+                    std::cout << "The png file has unsupported bits per channel:"<<(int)parsedData.bpp<<"\n";
+                }
+                if(!colorTypeSupported){
+                    std::cout << "The png file has unsupported color type: "<<(int)parsedData.colorType << " (" << (parsedData.colorType < 7 ? colorTypes[(int)parsedData.colorType] : "ERROR") << ")\n";
+                }
+                if(!interlaceMethodSupported){
+                    std::cout << "The png file has unsupported interlace method:"<<(int)parsedData.interlaceMethod<<"\n";
+                }
+                if(!filterMethodSupported){
+                    std::cout << "The png file has unsupported filter method:"<<(int)parsedData.filterMethod<<"\n";
+                }
+                if(!compressionMethodSupported){
+                    std::cout << "The png file has unsupported compression method:"<<(int)parsedData.compressionMethod<<"\n";
+                }
+                std::cerr<<"PNG file is not supported\n";
+                //return false;
+            }
+        }
+        else if (chunkType == "IDAT") {
+            parsedData.compressedData.insert(parsedData.compressedData.end(), reader, reader + length);
+        }else if (chunkType == "IEND"){
+            if(!decompressData(parsedData)){
+                result = false;
+            }
+        }else if (chunkType == "gAMA" || chunkType == "sRGB" || chunkType == "cHRM" || chunkType == "iCCP"){
+            //color information is applied by StreamDecoder (--color), here the stored samples are kept
+        }else if (chunkType == "acTL" || chunkType == "fcTL" || chunkType == "fdAT"){
+            //animation chunks are decoded by APNGDecoder, here only the default image is kept
+        }else{
+            std::cout << "Unhandled Chunktype "<<chunkType<<" Encountered\n";
+        }
+
+        reader += length + 4; // skip data and CRC
+    }
+    
+    return result;
+}
+
+//Reads only the signature and IHDR (first 33 bytes) of the file, nothing is decompressed
+bool Parser::probe(const std::string& filepath, ParsedData& parsedData) {
+    //signature(8) + length(4) + type(4) + IHDR data(13) + CRC(4)
+    const u32 probeSize = 33;
+    char buffer[probeSize];
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open file " << filepath << "\n";
+        return false;
+    }
+    if (!file.read(buffer, probeSize)) {
+        std::cerr << "The provided file " << filepath << " is too small to be a PNG file\n";
+        return false;
+    }
+
+    const unsigned char pngHeader[8] = {
+        0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    if (std::memcmp(buffer, pngHeader, 8) != 0) {
+        std::cerr << "The provided file " << filepath << " is not a valid PNG file\n";
+        return false;
+    }
+    //IHDR must be the first chunk
+    if (readLittleEndian32(&buffer[8]) != 13 || std::memcmp(&buffer[12], "IHDR", 4) != 0) {
+        std::cerr << "The provided file " << filepath << " does not start with an IHDR chunk\n";
+        return false;
+    }
+    readIHDR(&buffer[16],parsedData);
+    return true;
+}
+
+//Probes every file on a thread pool, results[i] and succeeded[i] belong to filepaths[i]
+u32 Parser::probeBatch(const std::vector<std::string>& filepaths, std::vector<ParsedData>& results, std::vector<bool>& succeeded, u32 threadCount) {
+    results.assign(filepaths.size(), ParsedData());
+    //vector<bool> is bit packed so the workers write into bytes instead
+    std::vector<u8> ok(filepaths.size(), 0);
+    ThreadPool pool(threadCount);
+    //every worker takes a contiguous range of files so each job is more than a single open/read
+    size_t jobCount = pool.size() * 4;
+    size_t perJob = (filepaths.size() + jobCount - 1) / jobCount;
+    for (size_t first = 0; first < filepaths.size(); first += perJob) {
+        size_t last = std::min(first + perJob, filepaths.size());
+        pool.enqueue([this, &filepaths, &results, &ok, first, last]() {
+            for (size_t i = first; i < last; i++) {
+                ok[i] = probe(filepaths[i], results[i]) ? 1 : 0;
+            }
+        });
+    }
+    pool.wait();
+
+    u32 probed = 0;
+    succeeded.assign(filepaths.size(), false);
+    for (size_t i = 0; i < filepaths.size(); i++) {
+        succeeded[i] = ok[i] != 0;
+        probed += ok[i];
+    }
+    return probed;
+}
+
+//Inflates the concatenated IDAT data into imageData (the filtered scanlines)
+bool Parser::decompressData(ParsedData& parsedData) {
+    if(parsedData.compressedData.size() < 2){
+        std::cerr << "No image data\n";
+        return false;
+    }
+    std::vector<u8>& imageData = parsedData.imageData;
+    //filter byte + pixels per scanline, only a hint so a bogus header cant reserve gigabytes
+    uint64_t expected = ((uint64_t)parsedData.width*parsedData.pixelBytes() + 1)*parsedData.height;
+    imageData.reserve((size_t)std::min<uint64_t>(expected,(uint64_t)256 << 20));
+    Inflater inflater([&imageData](const u8* data,size_t size){
+        imageData.insert(imageData.end(),data,data + size);
+    });
+    Inflater::Status status = inflater.feed((const u8*)parsedData.compressedData.data(),parsedData.compressedData.size());
+    if(status != Inflater::INFLATE_DONE){
+        if(status == Inflater::INFLATE_NEED_INPUT){
+            std::cerr << "Compressed data ended early\n";
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PARSER
+#define PARSER
+
+#include <vector>
+#include <string>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+struct ParsedData{
+    u32 width=0;
+    u32 height=0;
+    u8 bpp=0;
+    u8 colorType=0;
+    u8 compressionMethod=0;
+    u8 filterMethod=0;
+    u8 interlaceMethod=0;
+    std::vector<char> compressedData;
+    std::vector<u8> imageData;
+
+    //bytes per pixel of the defiltered scanlines
+    u32 pixelBytes() const{
+        return colorType == 6 ? 4 : 3;
+    }
+};
+
+//names of the IHDR color types, "ERROR" for the unused values
+extern const char colorTypes[7][20];
+
+/*
+    Whole file png parser, the IDAT data is gathered and inflated once IEND is reached.
+    imageData holds the filtered scanlines (filter byte + width*pixelBytes() bytes per row).
+*/
+class Parser {
+public:
+    bool parse(const std::string& filepath, ParsedData& parsedData);
+    //Copies the whole file into buffer
+    bool readFile(const std::string& filepath, std::vector<char>& buffer);
+    //Parses a png that is already in memory
+    bool parseBuffer(const char* data, size_t size, ParsedData& parsedData);
+    //Reads only the signature and IHDR (first 33 bytes) of the file, nothing is decompressed
+    bool probe(const std::string& filepath, ParsedData& parsedData);
+    //Probes every file on a thread pool, results[i] and succeeded[i] belong to filepaths[i]
+    u32 probeBatch(const std::vector<std::string>& filepaths, std::vector<ParsedData>& results, std::vector<bool>& succeeded, u32 threadCount = 0);
+    //Inflates the concatenated IDAT data into imageData (the filtered scanlines)
+    bool decompressData(ParsedData& parsedData);
+};
+
+#endif
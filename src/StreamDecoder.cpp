@@ -0,0 +1,286 @@
+#include "StreamDecoder.h"
+#include "Defilter.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+static u32 readBigEndian32(const u8* data){
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | (u32)data[3];
+}
+
+StreamDecoder::StreamDecoder(HeaderCallback _onHeader,ScanlineCallback _onScanline)
+:onHeader(_onHeader),onScanline(_onScanline),state(STATE_SIGNATURE),pendingFill(0),chunkRemaining(0),
+headerRead(false),pixelBytes(0),rowBytes(0),rowFill(0),currentY(0),colorOutput(COLOR_AS_IS),colorResolved(false)
+{
+
+}
+
+bool StreamDecoder::finished() const{
+    return state == STATE_DONE;
+}
+
+const ImageHeader& StreamDecoder::getHeader() const{
+    return header;
+}
+
+u32 StreamDecoder::getPixelBytes() const{
+    return pixelBytes;
+}
+
+void StreamDecoder::setColorOutput(ColorOutput output){
+    colorOutput = output;
+}
+
+//largest width and height the png spec allows
+static const u32 maxDimension = 0x7fffffff;
+
+void StreamDecoder::setLimits(const DecodeLimits& _limits){
+    limits = _limits;
+}
+
+const ColorProfile& StreamDecoder::getColorProfile() const{
+    return colorProfile;
+}
+
+//The color chunks all come before the image data, the table is picked once the first IDAT starts
+void StreamDecoder::resolveColor(){
+    colorResolved = true;
+    colorLUT = getColorLUT(colorProfile,colorOutput);
+    if(colorLUT){
+        colorRow.assign(rowBytes,0);
+    }
+}
+
+bool StreamDecoder::fail(const char* message){
+    std::cerr << "Stream decode error: " << message << "\n";
+    state = STATE_ERROR;
+    return false;
+}
+
+//Collects count bytes into pending, returns false if the slice ran out first
+bool StreamDecoder::gather(const u8*& reader,const u8* end,u32 count){
+    u32 needed = std::min<size_t>(count - pendingFill,end - reader);
+    std::memcpy(pending + pendingFill,reader,needed);
+    pendingFill += needed;
+    reader += needed;
+    return pendingFill == count;
+}
+
+bool StreamDecoder::readHeaderChunk(){
+    const u8* data = chunkData.data();
+    header.width = readBigEndian32(&data[0]);
+    header.height = readBigEndian32(&data[4]);
+    header.bpp = data[8];
+    header.colorType = data[9];
+    header.compressionMethod = data[10];
+    header.filterMethod = data[11];
+    header.interlaceMethod = data[12];
+    headerRead = true;
+
+    bool supported = (
+        (header.bpp == 8) &&
+        (header.colorType == 2 || header.colorType == 6) &&
+        (header.filterMethod == 0) &&
+        (header.interlaceMethod == 0) &&
+        (header.compressionMethod == 0)
+    );
+    if(!supported){
+        return fail("PNG file is not supported (only 8 bit non interlaced Truecolor and Truecolor and Alpha)");
+    }
+    if(header.width == 0 || header.height == 0){
+        return fail("image has no pixels");
+    }
+    if(header.width > maxDimension || header.height > maxDimension){
+        return fail("image width or height is over 2^31-1");
+    }
+    pixelBytes = (header.colorType == 6) ? 4 : 3;
+    //fits in 64 bits, the image size is compared by division so it cant wrap
+    u64 imageRowBytes = (u64)header.width*pixelBytes;
+    if(imageRowBytes > limits.maxRowBytes){
+        return fail("scanline is larger than the decode limit");
+    }
+    if(imageRowBytes > limits.maxImageBytes/header.height){
+        return fail("image is larger than the decode limit");
+    }
+    rowBytes = (size_t)imageRowBytes;
+    filteredRow.assign(rowBytes + 1,0);
+    prevRow.assign(rowBytes,0);
+    currentRow.assign(rowBytes,0);
+    inflater.reset(new Inflater([this](const u8* data,size_t size){
+        addImageData(data,size);
+    }));
+    if(onHeader){
+        onHeader(header);
+    }
+    return true;
+}
+
+//Splits the inflated data into scanlines and defilters each one as soon as it is complete
+void StreamDecoder::addImageData(const u8* data,size_t size){
+    const u8* reader = data;
+    const u8* end = data + size;
+    while(reader < end && currentY < header.height && state != STATE_ERROR){
+        size_t count = std::min<size_t>(filteredRow.size() - rowFill,end - reader);
+        std::memcpy(filteredRow.data() + rowFill,reader,count);
+        rowFill += count;
+        reader += count;
+        if(rowFill < filteredRow.size()){
+            return;
+        }
+        u8 filterType = filteredRow[0];
+        if(filterType > 4){
+            fail("invalid filter type");
+            return;
+        }
+        defilterScanline(filteredRow.data() + 1,filterType,(currentY>0?prevRow.data():nullptr),currentRow.data(),rowBytes,pixelBytes);
+        //the next row is defiltered against the stored samples, so the converted row goes to a separate buffer
+        const u8* output = currentRow.data();
+        if(colorLUT){
+            applyColorLUT(*colorLUT,currentRow.data(),colorRow.data(),header.width,pixelBytes);
+            output = colorRow.data();
+        }
+        if(onScanline){
+            onScanline(currentY,output);
+        }
+        std::swap(prevRow,currentRow);
+        currentY++;
+        rowFill = 0;
+    }
+}
+
+bool StreamDecoder::finishChunk(){
+    if(std::memcmp(chunkType,"IHDR",4) == 0){
+        return readHeaderChunk();
+    }
+    //a broken color chunk only loses the correction, the image still decodes
+    bool colorRead = true;
+    if(std::memcmp(chunkType,"gAMA",4) == 0){
+        colorRead = colorProfile.readGamma(chunkData.data(),(u32)chunkData.size());
+    }else if(std::memcmp(chunkType,"sRGB",4) == 0){
+        colorRead = colorProfile.readSRGB(chunkData.data(),(u32)chunkData.size());
+    }else if(std::memcmp(chunkType,"cHRM",4) == 0){
+        colorRead = colorProfile.readChromaticities(chunkData.data(),(u32)chunkData.size());
+    }else if(std::memcmp(chunkType,"iCCP",4) == 0){
+        colorRead = colorProfile.readICC(chunkData.data(),(u32)chunkData.size());
+    }
+    if(!colorRead){
+        std::cerr << "Ignoring invalid " << std::string(chunkType,4) << " chunk\n";
+    }
+    if(std::memcmp(chunkType,"IEND",4) == 0){
+        if(!inflater || !inflater->finished() || currentY != header.height){
+            return fail("image data ended before the last scanline");
+        }
+    }
+    return true;
+}
+
+bool StreamDecoder::feed(const u8* data,size_t size){
+    const u8* reader = data;
+    const u8* end = data + size;
+    while(reader < end){
+        switch(state){
+            case STATE_SIGNATURE:{
+                if(!gather(reader,end,8)){
+                    return true;
+                }
+                const unsigned char pngHeader[8] = {
+                    0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+                };
+                if(std::memcmp(pending,pngHeader,8) != 0){
+                    return fail("not a valid PNG file");
+                }
+                pendingFill = 0;
+                state = STATE_CHUNK_HEADER;
+                break;
+            }
+            case STATE_CHUNK_HEADER:{
+                if(!gather(reader,end,8)){
+                    return true;
+                }
+                pendingFill = 0;
+                chunkRemaining = readBigEndian32(pending);
+                std::memcpy(chunkType,pending + 4,4);
+                bool isHeader = std::memcmp(chunkType,"IHDR",4) == 0;
+                if(headerRead == isHeader){
+                    return fail(isHeader ? "more than one IHDR chunk" : "first chunk is not IHDR");
+                }
+                if(isHeader && chunkRemaining != 13){
+                    return fail("IHDR chunk has the wrong length");
+                }
+                chunkData.clear();
+                state = STATE_CHUNK_DATA;
+                if(chunkRemaining == 0){
+                    if(!finishChunk()){
+                        return false;
+                    }
+                    state = STATE_CHUNK_CRC;
+                }
+                break;
+            }
+            case STATE_CHUNK_DATA:{
+                u32 count = std::min<size_t>(chunkRemaining,end - reader);
+                if(std::memcmp(chunkType,"IDAT",4) == 0){
+                    if(!colorResolved){
+                        resolveColor();
+                    }
+                    if(inflater->feed(reader,count) == Inflater::INFLATE_ERROR){
+                        return fail("corrupt image data");
+                    }
+                    if(state == STATE_ERROR){
+                        return false;
+                    }
+                }else if(std::memcmp(chunkType,"IHDR",4) == 0 || std::memcmp(chunkType,"gAMA",4) == 0 ||
+                         std::memcmp(chunkType,"sRGB",4) == 0 || std::memcmp(chunkType,"cHRM",4) == 0 ||
+                         std::memcmp(chunkType,"iCCP",4) == 0){
+                    chunkData.insert(chunkData.end(),reader,reader + count);
+                }
+                //other chunks are skipped
+                reader += count;
+                chunkRemaining -= count;
+                if(chunkRemaining == 0){
+                    if(!finishChunk()){
+                        return false;
+                    }
+                    state = STATE_CHUNK_CRC;
+                }
+                break;
+            }
+            case STATE_CHUNK_CRC:{
+                if(!gather(reader,end,4)){
+                    return true;
+                }
+                pendingFill = 0;
+                state = (std::memcmp(chunkType,"IEND",4) == 0) ? STATE_DONE : STATE_CHUNK_HEADER;
+                break;
+            }
+            case STATE_DONE:
+                //anything after IEND is ignored
+                return true;
+            case STATE_ERROR:
+                return false;
+        }
+    }
+    return state != STATE_ERROR;
+}
+
+bool decodePixels(const u8* data,size_t size,std::vector<u8>& pixels,ImageHeader& header,ColorOutput colorOutput,u64 maxImageBytes){
+    size_t rowBytes = 0;
+    pixels.clear();
+    StreamDecoder decoder(
+        [&](const ImageHeader& imageHeader){
+            header = imageHeader;
+            rowBytes = (size_t)imageHeader.width*(imageHeader.colorType == 6 ? 4 : 3);
+            //only a hint, the rows are appended as they decode
+            pixels.reserve((size_t)std::min<u64>((u64)rowBytes*imageHeader.height,(u64)256 << 20));
+        },
+        [&](u32,const u8* row){
+            pixels.insert(pixels.end(),row,row + rowBytes);
+        }
+    );
+    DecodeLimits limits;
+    limits.maxImageBytes = maxImageBytes;
+    decoder.setLimits(limits);
+    decoder.setColorOutput(colorOutput);
+    return decoder.feed(data,size) && decoder.finished();
+}
@@ -0,0 +1,109 @@
+#ifndef STREAMDECODER
+#define STREAMDECODER
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include "Inflater.h"
+#include "ColorProfile.h"
+
+//Upper bounds checked when IHDR is read, before anything for the image is allocated.
+//Width and height over 2^31-1 are refused by the spec, whatever the limits say
+struct DecodeLimits{
+    u64 maxRowBytes=(u64)1 << 28;   //width*pixelBytes, three rows of it are kept while decoding
+    u64 maxImageBytes=~0ull;    //width*height*pixelBytes of the defiltered image, for callers that keep all of it
+};
+
+//Image byte limit of the decodes that keep the whole image in memory
+static const u64 defaultMaxImageBytes = (u64)1 << 30;
+
+struct ImageHeader{
+    u32 width=0;
+    u32 height=0;
+    u8 bpp=0;
+    u8 colorType=0;
+    u8 compressionMethod=0;
+    u8 filterMethod=0;
+    u8 interlaceMethod=0;
+};
+
+/*
+    Push style png decoder, the file can be fed in slices of any size
+    (a slice can end in the middle of a chunk header, a chunk or a huffman code).
+    onHeader fires once IHDR is read and onScanline for every defiltered scanline,
+    only the deflate window and two scanlines are kept in memory.
+    gAMA, sRGB, cHRM and iCCP are read into the color profile, with a color output set
+    every scanline goes through the profile's lookup table right after it is defiltered.
+    Supports 8 bit Truecolor and Truecolor and Alpha, not interlaced.
+*/
+class StreamDecoder{
+    public:
+    typedef std::function<void(const ImageHeader& header)> HeaderCallback;
+    typedef std::function<void(u32 y,const u8* row)> ScanlineCallback;
+
+    StreamDecoder(HeaderCallback _onHeader,ScanlineCallback _onScanline);
+    //returns false once the stream is found to be invalid
+    bool feed(const u8* data,size_t size);
+    //true after IEND with every scanline decoded
+    bool finished() const;
+    const ImageHeader& getHeader() const;
+    //bytes per pixel of the rows handed to onScanline
+    u32 getPixelBytes() const;
+    //has to be set before the first IDAT chunk, COLOR_AS_IS by default
+    void setColorOutput(ColorOutput output);
+    //has to be set before IHDR, an image over the limits fails the decode
+    void setLimits(const DecodeLimits& _limits);
+    const ColorProfile& getColorProfile() const;
+
+    private:
+    enum State{
+        STATE_SIGNATURE=0,
+        STATE_CHUNK_HEADER,
+        STATE_CHUNK_DATA,
+        STATE_CHUNK_CRC,
+        STATE_DONE,
+        STATE_ERROR
+    };
+    HeaderCallback onHeader;
+    ScanlineCallback onScanline;
+    State state;
+    u8 pending[8];      //signature, chunk header or crc bytes collected across slices
+    u32 pendingFill;
+    u32 chunkRemaining;
+    char chunkType[4];
+    std::vector<u8> chunkData;
+
+    DecodeLimits limits;
+    ImageHeader header;
+    bool headerRead;
+    u32 pixelBytes;
+    size_t rowBytes;
+    std::unique_ptr<Inflater> inflater;
+    std::vector<u8> filteredRow;    //filter byte + rowBytes
+    size_t rowFill;
+    std::vector<u8> prevRow;
+    std::vector<u8> currentRow;
+    u32 currentY;
+
+    ColorProfile colorProfile;
+    ColorOutput colorOutput;
+    bool colorResolved;
+    std::shared_ptr<const ColorLUT> colorLUT;
+    std::vector<u8> colorRow;
+
+    bool fail(const char* message);
+    bool gather(const u8*& reader,const u8* end,u32 count);
+    bool readHeaderChunk();
+    bool finishChunk();
+    void resolveColor();
+    void addImageData(const u8* data,size_t size);
+};
+
+/*
+    Decodes a png in memory into tightly packed scanlines (width*pixelBytes per row).
+    Images over maxImageBytes fail before anything is allocated and pixels only grows
+    with the scanlines that actually decode, so a bogus header cant reserve gigabytes.
+*/
+bool decodePixels(const u8* data,size_t size,std::vector<u8>& pixels,ImageHeader& header,ColorOutput colorOutput = COLOR_AS_IS,u64 maxImageBytes = defaultMaxImageBytes);
+
+#endif
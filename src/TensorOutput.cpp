@@ -0,0 +1,304 @@
+#include "TensorOutput.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+//the F16C conversion is built whatever the compile flags and picked at runtime
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TENSOR_F16C_DISPATCH
+#include <immintrin.h>
+#endif
+
+typedef unsigned short u16;
+
+void TensorFormat::setNormalization(const float mean[3],const float std[3]){
+    for(u32 c=0;c<3;c++){
+        scale[c] = 1.0f/(255.0f*std[c]);
+        bias[c] = -mean[c]/std[c];
+    }
+    scale[3] = 1.0f/255.0f;
+    bias[3] = 0;
+}
+
+static size_t elementBytes(TensorType type){
+    return type == TENSOR_F32 ? 4 : (type == TENSOR_F16 ? 2 : 1);
+}
+
+size_t tensorBytes(const TensorFormat& format,u32 width,u32 height){
+    return (size_t)width*height*format.channels*elementBytes(format.type);
+}
+
+static void freeTensor(u8* tensor){
+#ifdef _WIN32
+    _aligned_free(tensor);
+#else
+    free(tensor);
+#endif
+}
+
+std::unique_ptr<u8[],void(*)(u8*)> allocateTensor(size_t bytes){
+    const size_t alignment = 64;
+    //aligned_alloc wants a multiple of the alignment
+    size_t rounded = std::max(alignment,(bytes + alignment - 1)/alignment*alignment);
+    u8* tensor = nullptr;
+#ifdef _WIN32
+    tensor = (u8*)_aligned_malloc(rounded,alignment);
+#else
+    tensor = (u8*)aligned_alloc(alignment,rounded);
+#endif
+    if(tensor){
+        std::memset(tensor,0,rounded);
+    }
+    return std::unique_ptr<u8[],void(*)(u8*)>(tensor,freeTensor);
+}
+
+//round(value*alpha/255) without a division
+static inline u8 premultiplyChannel(u32 value,u32 alpha){
+    u32 x = value*alpha + 128;
+    return (u8)((x + (x >> 8)) >> 8);
+}
+
+#ifdef __SSE2__
+//the same rounding for two RGBA pixels in 16 bit lanes, the alpha lanes are kept
+static inline __m128i premultiply16(__m128i pixels){
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i colorMask = _mm_set_epi16(0,-1,-1,-1,0,-1,-1,-1);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(pixels,alpha),half);
+    __m128i result = _mm_srli_epi16(_mm_add_epi16(x,_mm_srli_epi16(x,8)),8);
+    return _mm_or_si128(_mm_and_si128(result,colorMask),_mm_andnot_si128(colorMask,pixels));
+}
+#endif
+
+static void premultiplyRGBA(const u8* in,u32 width,u8* out){
+    u32 x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(;x+4<=width;x+=4){
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(in + x*4));
+        __m128i low = premultiply16(_mm_unpacklo_epi8(pixels,zero));
+        __m128i high = premultiply16(_mm_unpackhi_epi8(pixels,zero));
+        _mm_storeu_si128((__m128i*)(out + x*4),_mm_packus_epi16(low,high));
+    }
+#endif
+    for(;x<width;x++){
+        u32 alpha = in[x*4+3];
+        out[x*4+0] = premultiplyChannel(in[x*4+0],alpha);
+        out[x*4+1] = premultiplyChannel(in[x*4+1],alpha);
+        out[x*4+2] = premultiplyChannel(in[x*4+2],alpha);
+        out[x*4+3] = (u8)alpha;
+    }
+}
+
+//Row with pixelBytes per pixel to a row with channels per pixel, premultiplied if asked
+static void repackRow(const u8* in,u32 pixelBytes,u32 width,u32 channels,bool premultiply,u8* out){
+    if(pixelBytes == 4 && channels == 4 && premultiply){
+        premultiplyRGBA(in,width,out);
+        return;
+    }
+    for(u32 x=0;x<width;x++){
+        const u8* pixel = in + (size_t)x*pixelBytes;
+        u8* target = out + (size_t)x*channels;
+        u32 alpha = pixelBytes == 4 ? pixel[3] : 255;
+        for(u32 c=0;c<3;c++){
+            target[c] = (premultiply && alpha != 255) ? premultiplyChannel(pixel[c],alpha) : pixel[c];
+        }
+        if(channels == 4){
+            target[3] = (u8)alpha;
+        }
+    }
+}
+
+//out[i] = in[i]*scale[i%12] + bias[i%12], the 12 value pattern repeats for 1, 3 and 4 channels
+static void convertToFloat(const u8* in,size_t count,const float scalePattern[12],const float biasPattern[12],float* out){
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scales[3] = {_mm_loadu_ps(scalePattern),_mm_loadu_ps(scalePattern + 4),_mm_loadu_ps(scalePattern + 8)};
+    const __m128 biases[3] = {_mm_loadu_ps(biasPattern),_mm_loadu_ps(biasPattern + 4),_mm_loadu_ps(biasPattern + 8)};
+    u32 phase = 0;
+    for(;i+16<=count;i+=16){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i low = _mm_unpacklo_epi8(bytes,zero);
+        __m128i high = _mm_unpackhi_epi8(bytes,zero);
+        __m128i quads[4] = {
+            _mm_unpacklo_epi16(low,zero),_mm_unpackhi_epi16(low,zero),
+            _mm_unpacklo_epi16(high,zero),_mm_unpackhi_epi16(high,zero)
+        };
+        for(u32 k=0;k<4;k++){
+            __m128 value = _mm_cvtepi32_ps(quads[k]);
+            _mm_storeu_ps(out + i + k*4,_mm_add_ps(_mm_mul_ps(value,scales[phase]),biases[phase]));
+            phase = (phase == 2) ? 0 : phase + 1;
+        }
+    }
+#endif
+    for(;i<count;i++){
+        out[i] = in[i]*scalePattern[i%12] + biasPattern[i%12];
+    }
+}
+
+//IEEE half with round to nearest even
+static u16 floatToHalf(float value){
+    u32 bits;
+    std::memcpy(&bits,&value,4);
+    u32 sign = (bits >> 16) & 0x8000;
+    u32 exponent = (bits >> 23) & 0xff;
+    u32 mantissa = bits & 0x7fffff;
+    if(exponent == 0xff){
+        return (u16)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    int halfExponent = (int)exponent - 127 + 15;
+    if(halfExponent >= 31){
+        return (u16)(sign | 0x7c00);
+    }
+    if(halfExponent <= 0){
+        //subnormal or zero
+        if(halfExponent < -10){
+            return (u16)sign;
+        }
+        mantissa |= 0x800000;
+        u32 shift = (u32)(14 - halfExponent);
+        u32 half = mantissa >> shift;
+        u32 rest = mantissa & ((1u << shift) - 1);
+        u32 halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1))){
+            half++;
+        }
+        return (u16)(sign | half);
+    }
+    u32 half = ((u32)halfExponent << 10) | (mantissa >> 13);
+    u32 rest = mantissa & 0x1fff;
+    //a carry out of the mantissa correctly bumps the exponent
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1))){
+        half++;
+    }
+    return (u16)(sign | half);
+}
+
+#ifdef TENSOR_F16C_DISPATCH
+//convertToFloat and the half conversion in one pass, only called when the cpu has F16C
+__attribute__((target("f16c")))
+static void convertToHalfF16C(const u8* in,size_t count,const float scalePattern[12],const float biasPattern[12],u16* out){
+    size_t i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scales[3] = {_mm_loadu_ps(scalePattern),_mm_loadu_ps(scalePattern + 4),_mm_loadu_ps(scalePattern + 8)};
+    const __m128 biases[3] = {_mm_loadu_ps(biasPattern),_mm_loadu_ps(biasPattern + 4),_mm_loadu_ps(biasPattern + 8)};
+    u32 phase = 0;
+    for(;i+16<=count;i+=16){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i low = _mm_unpacklo_epi8(bytes,zero);
+        __m128i high = _mm_unpackhi_epi8(bytes,zero);
+        __m128i quads[4] = {
+            _mm_unpacklo_epi16(low,zero),_mm_unpackhi_epi16(low,zero),
+            _mm_unpacklo_epi16(high,zero),_mm_unpackhi_epi16(high,zero)
+        };
+        for(u32 k=0;k<4;k++){
+            __m128 value = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(quads[k]),scales[phase]),biases[phase]);
+            _mm_storel_epi64((__m128i*)(out + i + k*4),_mm_cvtps_ph(value,_MM_FROUND_TO_NEAREST_INT));
+            phase = (phase == 2) ? 0 : phase + 1;
+        }
+    }
+    for(;i<count;i++){
+        out[i] = floatToHalf(in[i]*scalePattern[i%12] + biasPattern[i%12]);
+    }
+}
+
+static bool hasF16C(){
+    static const bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+}
+#endif
+
+static void convertToHalf(const u8* in,size_t count,const float scalePattern[12],const float biasPattern[12],u16* out){
+#ifdef TENSOR_F16C_DISPATCH
+    if(hasF16C()){
+        convertToHalfF16C(in,count,scalePattern,biasPattern,out);
+        return;
+    }
+#endif
+    thread_local std::vector<float> floats;
+    floats.resize(count);
+    convertToFloat(in,count,scalePattern,biasPattern,floats.data());
+    for(size_t i=0;i<count;i++){
+        out[i] = floatToHalf(floats[i]);
+    }
+}
+
+//count u8 values to the output type, value i belongs to channel (firstChannel + i) % period,
+//period 1 is a single channel (a planar row)
+static void convertValues(const u8* in,size_t count,u32 period,u32 firstChannel,const TensorFormat& format,u8* out){
+    if(format.type == TENSOR_U8){
+        std::memcpy(out,in,count);
+        return;
+    }
+    float scalePattern[12];
+    float biasPattern[12];
+    for(u32 i=0;i<12;i++){
+        u32 channel = (period == 1) ? firstChannel : (firstChannel + i) % period;
+        scalePattern[i] = format.scale[channel];
+        biasPattern[i] = format.bias[channel];
+    }
+    if(format.type == TENSOR_F32){
+        convertToFloat(in,count,scalePattern,biasPattern,(float*)out);
+        return;
+    }
+    convertToHalf(in,count,scalePattern,biasPattern,(u16*)out);
+}
+
+void writeTensorRow(const u8* row,u32 pixelBytes,u32 y,u32 width,u32 height,const TensorFormat& format,u8* tensor){
+    const u32 channels = format.channels;
+    const size_t valueBytes = elementBytes(format.type);
+    thread_local std::vector<u8> staging;
+    const u8* source = row;
+    if(pixelBytes != channels || format.premultiply){
+        staging.resize((size_t)width*channels);
+        repackRow(row,pixelBytes,width,channels,format.premultiply,staging.data());
+        source = staging.data();
+    }
+    if(format.layout == TENSOR_INTERLEAVED){
+        u8* out = tensor + (size_t)y*width*channels*valueBytes;
+        convertValues(source,(size_t)width*channels,channels,0,format,out);
+        return;
+    }
+    //planar, one channel at a time out of the row
+    thread_local std::vector<u8> plane;
+    plane.resize(width);
+    const size_t planeValues = (size_t)width*height;
+    for(u32 c=0;c<channels;c++){
+        for(u32 x=0;x<width;x++){
+            plane[x] = source[(size_t)x*channels + c];
+        }
+        u8* out = tensor + (c*planeValues + (size_t)y*width)*valueBytes;
+        convertValues(plane.data(),width,1,c,format,out);
+    }
+}
+
+bool decodeToTensor(const u8* data,size_t size,const TensorFormat& format,u8* tensor,size_t capacity,ImageHeader& header){
+    if(format.channels != 3 && format.channels != 4){
+        std::cerr << "Tensor output needs 3 or 4 channels\n";
+        return false;
+    }
+    bool fits = false;
+    u32 pixelBytes = 0;
+    StreamDecoder decoder(
+        [&](const ImageHeader& imageHeader){
+            header = imageHeader;
+            pixelBytes = imageHeader.colorType == 6 ? 4 : 3;
+            fits = tensorBytes(format,imageHeader.width,imageHeader.height) <= capacity;
+            if(!fits){
+                std::cerr << "Tensor buffer is too small for " << imageHeader.width << "x" << imageHeader.height << "\n";
+            }
+        },
+        [&](u32 y,const u8* row){
+            if(fits){
+                writeTensorRow(row,pixelBytes,y,header.width,header.height,format,tensor);
+            }
+        }
+    );
+    decoder.setColorOutput(format.color);
+    return decoder.feed(data,size) && decoder.finished() && fits;
+}
@@ -0,0 +1,56 @@
+#ifndef TENSOROUTPUT
+#define TENSOROUTPUT
+
+#include <cstddef>
+#include <memory>
+#include "StreamDecoder.h"
+
+enum TensorLayout{
+    TENSOR_INTERLEAVED=0,   //HWC
+    TENSOR_PLANAR           //CHW
+};
+
+enum TensorType{
+    TENSOR_U8=0,
+    TENSOR_F32,
+    TENSOR_F16
+};
+
+/*
+    Layout of the decoded pixels for ML preprocessing.
+    Float outputs are value*scale + bias per channel (value in 0-255), so mean/std
+    normalization is scale = 1/(255*std) and bias = -mean/std. u8 outputs ignore scale and bias.
+    channels 4 is RGBA (alpha 255 for Truecolor images), premultiply multiplies
+    the color channels by alpha before the conversion.
+    color converts the samples (sRGB or linear light) before anything else, see ColorOutput.
+*/
+struct TensorFormat{
+    TensorLayout layout=TENSOR_INTERLEAVED;
+    TensorType type=TENSOR_U8;
+    u32 channels=3;
+    bool premultiply=false;
+    ColorOutput color=COLOR_AS_IS;
+    float scale[4]={1,1,1,1};
+    float bias[4]={0,0,0,0};
+
+    //scale/bias for mean and std given in 0-1 units, alpha is mapped to 0-1
+    void setNormalization(const float mean[3],const float std[3]);
+};
+
+//Bytes needed for a width x height image in this format
+size_t tensorBytes(const TensorFormat& format,u32 width,u32 height);
+
+//64 byte aligned, zeroed buffer for tensorBytes
+std::unique_ptr<u8[],void(*)(u8*)> allocateTensor(size_t bytes);
+
+//Converts defiltered row y (pixelBytes 3 or 4) into its place in tensor
+void writeTensorRow(const u8* row,u32 pixelBytes,u32 y,u32 width,u32 height,const TensorFormat& format,u8* tensor);
+
+/*
+    Decodes a png straight into tensor, every scanline is converted while it is still
+    in cache right after it is defiltered, the interleaved image is never stored.
+    tensor has to hold tensorBytes() for the image size (Parser::probe or the header callback).
+*/
+bool decodeToTensor(const u8* data,size_t size,const TensorFormat& format,u8* tensor,size_t capacity,ImageHeader& header);
+
+#endif
@@ -0,0 +1,68 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(u32 threadCount)
+:activeJobs(0),stopping(false)
+{
+    if(threadCount == 0){
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if(threadCount == 0){
+        threadCount = 1;
+    }
+    workers.reserve(threadCount);
+    for(u32 i=0;i<threadCount;i++){
+        workers.emplace_back(&ThreadPool::workerLoop,this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> job){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobs.push(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::wait(){
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsDone.wait(lock,[this]{ return jobs.empty() && activeJobs == 0; });
+}
+
+u32 ThreadPool::size() const{
+    return (u32)workers.size();
+}
+
+void ThreadPool::workerLoop(){
+    while(true){
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock,[this]{ return stopping || !jobs.empty(); });
+            if(stopping && jobs.empty()){
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop();
+            activeJobs++;
+        }
+        job();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            activeJobs--;
+            if(jobs.empty() && activeJobs == 0){
+                jobsDone.notify_all();
+            }
+        }
+    }
+}
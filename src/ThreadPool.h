@@ -0,0 +1,33 @@
+#ifndef THREADPOOL
+#define THREADPOOL
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+typedef unsigned int u32;
+
+class ThreadPool{
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobsDone;
+    u32 activeJobs;
+    bool stopping;
+
+    void workerLoop();
+    public:
+    //threadCount 0 = one thread per hardware core
+    ThreadPool(u32 threadCount = 0);
+    ~ThreadPool();
+    void enqueue(std::function<void()> job);
+    //Blocks until every enqueued job has finished
+    void wait();
+    u32 size() const;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "Thumbnail.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//the output buffer is the only allocation that grows with maxSize
+static const uint64_t maxThumbnailBytes = (uint64_t)256 << 20;
+
+//sums[i] += row[i] for count bytes, 64 bit sums so a band of any height cant overflow
+static void accumulateRow(u64* sums,const u8* row,size_t count){
+    size_t i=0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(;i+16<=count;i+=16){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(row+i));
+        __m128i lo16 = _mm_unpacklo_epi8(bytes,zero);
+        __m128i hi16 = _mm_unpackhi_epi8(bytes,zero);
+        __m128i words[4] = {
+            _mm_unpacklo_epi16(lo16,zero),_mm_unpackhi_epi16(lo16,zero),
+            _mm_unpacklo_epi16(hi16,zero),_mm_unpackhi_epi16(hi16,zero)
+        };
+        __m128i* dst = (__m128i*)(sums+i);
+        for(u32 k=0;k<4;k++){
+            _mm_storeu_si128(dst+k*2,_mm_add_epi64(_mm_loadu_si128(dst+k*2),_mm_unpacklo_epi32(words[k],zero)));
+            _mm_storeu_si128(dst+k*2+1,_mm_add_epi64(_mm_loadu_si128(dst+k*2+1),_mm_unpackhi_epi32(words[k],zero)));
+        }
+    }
+#endif
+    for(;i<count;i++){
+        sums[i] += row[i];
+    }
+}
+
+bool createThumbnail(const u8* data,size_t size,u32 maxSize,Thumbnail& thumbnail,ColorOutput colorOutput){
+    thumbnail = Thumbnail();
+    std::vector<u64> columnSums;
+    u32 width = 0;
+    u32 height = 0;
+    u32 pixelBytes = 3;
+    u32 thumbY = 0;
+    u32 bandStart = 0;
+    bool allocated = false;
+    StreamDecoder decoder(
+        [&](const ImageHeader& header){
+            width = header.width;
+            height = header.height;
+            pixelBytes = header.colorType == 6 ? 4 : 3;
+            //only downscaling, the decoder already rejects images without pixels
+            u32 longestSide = std::max(1u,std::max(width,height));
+            u32 limit = std::max(1u,maxSize);
+            thumbnail.width = std::max(1u,std::min(width,(u32)(((uint64_t)width*limit)/longestSide)));
+            thumbnail.height = std::max(1u,std::min(height,(u32)(((uint64_t)height*limit)/longestSide)));
+            if((uint64_t)thumbnail.width*thumbnail.height*3 > maxThumbnailBytes){
+                std::cerr << "A " << thumbnail.width << "x" << thumbnail.height << " thumbnail is too large\n";
+                return;
+            }
+            thumbnail.pixels.resize((size_t)thumbnail.width*thumbnail.height*3);
+            columnSums.assign((size_t)width*pixelBytes,0);
+            allocated = true;
+        },
+        [&](u32 y,const u8* row){
+            if(!allocated)return;
+            accumulateRow(columnSums.data(),row,(size_t)width*pixelBytes);
+            //last source scanline of this output row
+            u32 bandEnd = (u32)(((uint64_t)(thumbY+1)*height)/thumbnail.height);
+            if(y+1 < bandEnd)return;
+
+            u32 bandRows = bandEnd - bandStart;
+            const u32 thumbWidth = thumbnail.width;
+            u8* writer = thumbnail.pixels.data() + (size_t)thumbY*thumbWidth*3;
+            for(u32 thumbX=0;thumbX<thumbWidth;thumbX++){
+                u32 x0 = (u32)(((uint64_t)thumbX*width)/thumbWidth);
+                u32 x1 = (u32)(((uint64_t)(thumbX+1)*width)/thumbWidth);
+                uint64_t count = (uint64_t)(x1-x0)*bandRows;
+                //Per channel, alpha is dropped
+                for(u32 i=0;i<3;i++){
+                    uint64_t sum = 0;
+                    for(u32 x=x0;x<x1;x++){
+                        sum += columnSums[(size_t)x*pixelBytes+i];
+                    }
+                    writer[thumbX*3+i] = (u8)((sum + count/2)/count);
+                }
+            }
+            std::fill(columnSums.begin(),columnSums.end(),0);
+            bandStart = bandEnd;
+            thumbY++;
+        }
+    );
+    decoder.setColorOutput(colorOutput);
+    if(!decoder.feed(data,size) || !decoder.finished() || !allocated){
+        thumbnail = Thumbnail();
+        return false;
+    }
+    return true;
+}
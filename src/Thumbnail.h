@@ -0,0 +1,24 @@
+#ifndef THUMBNAIL
+#define THUMBNAIL
+
+#include <vector>
+#include <cstddef>
+#include "StreamDecoder.h"
+
+//An rgb thumbnail, alpha is dropped
+struct Thumbnail{
+    u32 width=0;
+    u32 height=0;
+    std::vector<u8> pixels;     //width*height*3
+};
+
+/*
+    Area averaged thumbnail of a png in memory with a longest side of maxSize pixels (never upscaled),
+    made directly from the scanlines of a StreamDecoder, the full resolution image is never created.
+    Every source scanline is added into a per column sum, once all scanlines
+    of an output row are in, the columns are averaged horizontally into the output rgb row.
+    Returns false when the png does not decode.
+*/
+bool createThumbnail(const u8* data,size_t size,u32 maxSize,Thumbnail& thumbnail,ColorOutput colorOutput = COLOR_AS_IS);
+
+#endif
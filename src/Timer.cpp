@@ -7,12 +7,10 @@ Timer::Timer(){
 void Timer::stop(){
     end = std::chrono::high_resolution_clock::now();
 
-    long long startT = std::chrono::time_point_cast<std::chrono::milliseconds>(start).time_since_epoch().count();
-    long long endT = std::chrono::time_point_cast<std::chrono::milliseconds>(end).time_since_epoch().count();
+    //microsecond resolution so short operations (like probing) dont read as 0ms
+    long long dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 
-    long long dur = endT - startT;
-
-    dtms = (double)dur;
+    dtms = (double)dur / 1000.0;
 }
 
 Timer::~Timer(){
@@ -0,0 +1,332 @@
+/*
+    APNGDecoder against a plain reference compositor: every dispose_op/blend_op combination,
+    decodeFrame random access from the key frame without decoding the frames before it,
+    the vector blend compared with the scalar formula, and the open() bounds checks.
+*/
+#include "TestCheck.h"
+#include "APNGDecoder.h"
+#include "PNGEncoder.h"
+#include "Checksum.h"
+#include <cstring>
+
+struct TestFrame{
+    u32 width;
+    u32 height;
+    u32 xOffset;
+    u32 yOffset;
+    u8 disposeOp;
+    u8 blendOp;
+    std::vector<u8> rgba;
+};
+
+static void putBigEndian32(std::vector<u8>& out,u32 value){
+    const u8 bytes[4] = {(u8)(value >> 24),(u8)(value >> 16),(u8)(value >> 8),(u8)value};
+    out.insert(out.end(),bytes,bytes + 4);
+}
+
+//The zlib stream of a png made by encodePNG (all of its IDAT data)
+static std::vector<u8> zlibStream(const TestFrame& frame){
+    std::vector<u8> png;
+    CHECK(encodePNG(frame.rgba.data(),frame.width,frame.height,6,png));
+    std::vector<u8> stream;
+    size_t offset = 8;
+    while(offset + 12 <= png.size()){
+        u32 length = ((u32)png[offset] << 24) | ((u32)png[offset+1] << 16) | ((u32)png[offset+2] << 8) | png[offset+3];
+        if(std::memcmp(&png[offset+4],"IDAT",4) == 0){
+            stream.insert(stream.end(),png.begin() + offset + 8,png.begin() + offset + 8 + length);
+        }
+        offset += 12 + length;
+    }
+    return stream;
+}
+
+//RGBA apng, the first frame is the IDAT image, the others fdAT
+static std::vector<u8> makeAPNG(u32 width,u32 height,const std::vector<TestFrame>& frames){
+    std::vector<u8> png = {0x89,'P','N','G',0x0D,0x0A,0x1A,0x0A};
+    std::vector<u8> chunk;
+    putBigEndian32(chunk,width);
+    putBigEndian32(chunk,height);
+    const u8 rest[5] = {8,6,0,0,0};
+    chunk.insert(chunk.end(),rest,rest + 5);
+    writeChunk(png,"IHDR",chunk.data(),(u32)chunk.size());
+    chunk.clear();
+    putBigEndian32(chunk,(u32)frames.size());
+    putBigEndian32(chunk,0);
+    writeChunk(png,"acTL",chunk.data(),(u32)chunk.size());
+    u32 sequence = 0;
+    for(size_t i=0;i<frames.size();i++){
+        const TestFrame& frame = frames[i];
+        chunk.clear();
+        putBigEndian32(chunk,sequence++);
+        putBigEndian32(chunk,frame.width);
+        putBigEndian32(chunk,frame.height);
+        putBigEndian32(chunk,frame.xOffset);
+        putBigEndian32(chunk,frame.yOffset);
+        const u8 tail[6] = {0,1,0,10,frame.disposeOp,frame.blendOp};
+        chunk.insert(chunk.end(),tail,tail + 6);
+        writeChunk(png,"fcTL",chunk.data(),(u32)chunk.size());
+        std::vector<u8> stream = zlibStream(frame);
+        if(i == 0){
+            writeChunk(png,"IDAT",stream.data(),(u32)stream.size());
+        }else{
+            chunk.clear();
+            putBigEndian32(chunk,sequence++);
+            chunk.insert(chunk.end(),stream.begin(),stream.end());
+            writeChunk(png,"fdAT",chunk.data(),(u32)chunk.size());
+        }
+    }
+    writeChunk(png,"IEND",nullptr,0);
+    return png;
+}
+
+//The blend formula of the APNG spec on non premultiplied pixels
+static void referenceOver(u8* dst,const u8* src){
+    u32 srcAlpha = src[3];
+    if(srcAlpha == 255){
+        std::memcpy(dst,src,4);
+        return;
+    }
+    if(srcAlpha == 0){
+        return;
+    }
+    u32 u = srcAlpha*255;
+    u32 v = (255 - srcAlpha)*dst[3];
+    u32 alpha = u + v;
+    for(u32 c=0;c<3;c++){
+        dst[c] = (u8)((src[c]*u + dst[c]*v)/alpha);
+    }
+    dst[3] = (u8)(alpha/255);
+}
+
+//Straight from the spec, one pixel at a time
+static std::vector<std::vector<u8>> referenceCanvases(u32 width,u32 height,const std::vector<TestFrame>& frames){
+    std::vector<std::vector<u8>> canvases;
+    std::vector<u8> canvas((size_t)width*height*4,0);
+    for(size_t i=0;i<frames.size();i++){
+        const TestFrame& frame = frames[i];
+        std::vector<u8> saved = canvas;
+        for(u32 y=0;y<frame.height;y++){
+            for(u32 x=0;x<frame.width;x++){
+                u8* dst = &canvas[((size_t)(frame.yOffset + y)*width + frame.xOffset + x)*4];
+                const u8* src = &frame.rgba[((size_t)y*frame.width + x)*4];
+                if(frame.blendOp == APNG_BLEND_SOURCE){
+                    std::memcpy(dst,src,4);
+                }else{
+                    referenceOver(dst,src);
+                }
+            }
+        }
+        canvases.push_back(canvas);
+        //the first frame disposed to the previous canvas goes back to transparent black
+        if(frame.disposeOp == APNG_DISPOSE_BACKGROUND || (frame.disposeOp == APNG_DISPOSE_PREVIOUS && i == 0)){
+            for(u32 y=0;y<frame.height;y++){
+                std::memset(&canvas[((size_t)(frame.yOffset + y)*width + frame.xOffset)*4],0,(size_t)frame.width*4);
+            }
+        }else if(frame.disposeOp == APNG_DISPOSE_PREVIOUS){
+            canvas = saved;
+        }
+    }
+    return canvases;
+}
+
+//alpha is 0, 255 or anything in between so every blend path gets used
+static TestFrame makeFrame(u32 width,u32 height,u32 xOffset,u32 yOffset,u8 disposeOp,u8 blendOp,std::mt19937& random){
+    TestFrame frame = {width,height,xOffset,yOffset,disposeOp,blendOp,std::vector<u8>((size_t)width*height*4)};
+    for(size_t i=0;i<frame.rgba.size();i++){
+        frame.rgba[i] = (u8)random();
+        if(i % 4 == 3){
+            u32 pick = random() % 4;
+            frame.rgba[i] = pick == 0 ? 0 : (pick == 1 ? 255 : frame.rgba[i]);
+        }
+    }
+    return frame;
+}
+
+static bool decodeAllCanvases(const APNGDecoder& decoder,u32 threadCount,std::vector<std::vector<u8>>& canvases){
+    canvases.clear();
+    bool inOrder = true;
+    bool ok = decoder.decodeAll([&](u32 index,const std::vector<u8>& canvas){
+        inOrder = inOrder && index == canvases.size();
+        canvases.push_back(canvas);
+    },threadCount);
+    return ok && inOrder;
+}
+
+static void testDisposeAndBlend(){
+    std::mt19937 random(21);
+    const u32 width = 24;
+    const u32 height = 20;
+    u32 mismatches = 0;
+    u32 animations = 0;
+    //frames 1 and 2 go through every combination, they overlap each other and frame 3 is drawn over both
+    for(u8 dispose1=0;dispose1<3;dispose1++){
+        for(u8 blend1=0;blend1<2;blend1++){
+            for(u8 dispose2=0;dispose2<3;dispose2++){
+                for(u8 blend2=0;blend2<2;blend2++){
+                    std::vector<TestFrame> frames;
+                    frames.push_back(makeFrame(width,height,0,0,(u8)((dispose1 + dispose2) % 3),APNG_BLEND_SOURCE,random));
+                    frames.push_back(makeFrame(13,9,3,2,dispose1,blend1,random));
+                    frames.push_back(makeFrame(11,12,9,7,dispose2,blend2,random));
+                    frames.push_back(makeFrame(20,5,1,14,APNG_DISPOSE_NONE,APNG_BLEND_OVER,random));
+                    std::vector<u8> png = makeAPNG(width,height,frames);
+                    std::vector<std::vector<u8>> expected = referenceCanvases(width,height,frames);
+                    APNGDecoder decoder;
+                    if(!CHECK(decoder.open(png.data(),png.size()) && decoder.getFrameCount() == 4)){
+                        continue;
+                    }
+                    animations++;
+                    for(u32 threadCount : {1u,4u}){
+                        std::vector<std::vector<u8>> canvases;
+                        mismatches += (decodeAllCanvases(decoder,threadCount,canvases) && canvases == expected) ? 0 : 1;
+                    }
+                    for(u32 i=0;i<4;i++){
+                        std::vector<u8> canvas;
+                        mismatches += (decoder.decodeFrame(i,canvas) && canvas == expected[i]) ? 0 : 1;
+                    }
+                }
+            }
+        }
+    }
+    CHECK(animations == 36);
+    CHECK(mismatches == 0);
+}
+
+static void testRandomAccess(){
+    std::mt19937 random(8);
+    const u32 width = 16;
+    const u32 height = 16;
+    std::vector<TestFrame> frames;
+    for(u32 i=0;i<10;i++){
+        if(i == 5){
+            //replaces the whole canvas, frames 5 to 9 dont need anything before it
+            frames.push_back(makeFrame(width,height,0,0,APNG_DISPOSE_NONE,APNG_BLEND_SOURCE,random));
+        }else{
+            frames.push_back(makeFrame(6,5,i,i % 7,(u8)(i % 3),(u8)(i % 2),random));
+        }
+    }
+    frames[0] = makeFrame(width,height,0,0,APNG_DISPOSE_NONE,APNG_BLEND_SOURCE,random);
+    std::vector<u8> png = makeAPNG(width,height,frames);
+    std::vector<std::vector<u8>> expected = referenceCanvases(width,height,frames);
+
+    APNGDecoder decoder;
+    if(!CHECK(decoder.open(png.data(),png.size()))){
+        return;
+    }
+    for(u32 i=5;i<10;i++){
+        CHECK(decoder.getFrame(i).keyFrame == 5);
+    }
+    //break the zlib header of frames 2 and 4, only decodes that reach back to them fail
+    std::vector<u8> broken = png;
+    for(u32 index : {2u,4u}){
+        broken[decoder.getFrame(index).segments[0].first] = 0xff;
+    }
+    APNGDecoder brokenDecoder;
+    if(!CHECK(brokenDecoder.open(broken.data(),broken.size()))){
+        return;
+    }
+    for(u32 i=5;i<10;i++){
+        std::vector<u8> canvas;
+        CHECK(brokenDecoder.decodeFrame(i,canvas) && canvas == expected[i]);
+    }
+    std::vector<u8> canvas;
+    CHECK(!brokenDecoder.decodeFrame(4,canvas));
+    std::vector<std::vector<u8>> canvases;
+    CHECK(!decodeAllCanvases(brokenDecoder,4,canvases));
+    CHECK(!brokenDecoder.decodeFrame(10,canvas));
+}
+
+//compositeFrame blends with SSE2 where available, it has to match the scalar formula exactly
+static void testBlendPaths(){
+    std::mt19937 random(13);
+    u32 mismatches = 0;
+    for(u32 width=1;width<=19;width++){
+        for(u32 canvasKind=0;canvasKind<3;canvasKind++){
+            TestFrame frame = makeFrame(width,3,0,0,APNG_DISPOSE_NONE,APNG_BLEND_OVER,random);
+            std::vector<u8> canvas((size_t)width*3*4);
+            for(size_t i=0;i<canvas.size();i++){
+                canvas[i] = (u8)random();
+                //opaque canvas (the 16 bit lane path), transparent, or mixed
+                if(i % 4 == 3 && canvasKind < 2){
+                    canvas[i] = canvasKind == 0 ? 255 : 0;
+                }
+            }
+            std::vector<u8> expected = canvas;
+            for(size_t p=0;p<(size_t)width*3;p++){
+                referenceOver(&expected[p*4],&frame.rgba[p*4]);
+            }
+            APNGFrame apngFrame;
+            apngFrame.width = width;
+            apngFrame.height = 3;
+            apngFrame.blendOp = APNG_BLEND_OVER;
+            compositeFrame(canvas.data(),width,apngFrame,frame.rgba.data());
+            mismatches += canvas == expected ? 0 : 1;
+        }
+    }
+    CHECK(mismatches == 0);
+    //every source alpha over every opaque value of one channel
+    std::vector<u8> source(256*256*4);
+    std::vector<u8> canvas(256*256*4);
+    for(u32 a=0;a<256;a++){
+        for(u32 d=0;d<256;d++){
+            u8* src = &source[(a*256 + d)*4];
+            u8* dst = &canvas[(a*256 + d)*4];
+            src[0] = (u8)(255 - d);
+            src[1] = (u8)d;
+            src[2] = (u8)(a ^ d);
+            src[3] = (u8)a;
+            dst[0] = (u8)d;
+            dst[1] = (u8)(255 - d);
+            dst[2] = (u8)(a + d);
+            dst[3] = 255;
+        }
+    }
+    std::vector<u8> expected = canvas;
+    for(size_t p=0;p<256*256;p++){
+        referenceOver(&expected[p*4],&source[p*4]);
+    }
+    APNGFrame full;
+    full.width = 256;
+    full.height = 256;
+    full.blendOp = APNG_BLEND_OVER;
+    compositeFrame(canvas.data(),256,full,source.data());
+    CHECK(canvas == expected);
+}
+
+static void testBounds(){
+    std::mt19937 random(1);
+    std::vector<TestFrame> frames = {makeFrame(8,8,0,0,0,0,random),makeFrame(4,4,2,2,0,1,random)};
+    std::vector<u8> png = makeAPNG(8,8,frames);
+    APNGDecoder decoder;
+    CHECK(decoder.open(png.data(),png.size()));
+
+    //a frame one pixel past the right edge, and an offset that wraps in 32 bits
+    frames[1].xOffset = 5;
+    std::vector<u8> outside = makeAPNG(8,8,frames);
+    CHECK(!decoder.open(outside.data(),outside.size()));
+    frames[1].xOffset = 0xfffffffe;
+    outside = makeAPNG(8,8,frames);
+    CHECK(!decoder.open(outside.data(),outside.size()));
+
+    //a canvas over the limit fails in open, before anything is decoded
+    DecodeLimits limits;
+    limits.maxImageBytes = 8*8*4 - 1;
+    APNGDecoder limited;
+    limited.setLimits(limits);
+    CHECK(!limited.open(png.data(),png.size()));
+    limits.maxImageBytes = 8*8*4;
+    limited.setLimits(limits);
+    CHECK(limited.open(png.data(),png.size()));
+
+    //IHDR claiming 2^31 pixels across, the crc is not checked
+    std::vector<u8> huge = png;
+    huge[16] = 0x80;
+    CHECK(!decoder.open(huge.data(),huge.size()));
+}
+
+int main(){
+    testDisposeAndBlend();
+    testRandomAccess();
+    testBlendPaths();
+    testBounds();
+    return testResult("APNGTests");
+}
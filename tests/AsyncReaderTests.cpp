@@ -0,0 +1,123 @@
+/*
+    AsyncFileReader with io_uring (where the kernel allows it) and with the pread thread fallback:
+    every file completes exactly once with its bytes, missing files complete with nullptr,
+    and a small BufferPool holds the reads back until the consumers give buffers back.
+*/
+#include "TestCheck.h"
+#include "AsyncReader.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <mutex>
+
+struct TestFiles{
+    std::vector<std::string> paths;
+    std::vector<std::vector<char>> contents;    //empty with missing set for files that dont exist
+    std::vector<bool> missing;
+};
+
+static TestFiles makeFiles(const std::filesystem::path& directory){
+    std::mt19937 random(17);
+    TestFiles files;
+    //empty, tiny, page sized, odd sizes and one larger than a single read
+    const size_t sizes[8] = {0,1,4096,4097,65537,300001,(size_t)3 << 20,777};
+    for(u32 i=0;i<48;i++){
+        std::string path = (directory / ("file" + std::to_string(i) + ".bin")).string();
+        std::vector<char> content;
+        bool missing = i % 11 == 7;
+        if(!missing){
+            content.resize(sizes[i % 8]);
+            for(char& value : content){
+                value = (char)random();
+            }
+            CHECK(writeTestFile(path,content.data(),content.size()));
+        }
+        files.paths.push_back(path);
+        files.contents.push_back(content);
+        files.missing.push_back(missing);
+    }
+    //a directory cant be read as a file
+    files.paths.push_back(directory.string());
+    files.contents.push_back({});
+    files.missing.push_back(true);
+    return files;
+}
+
+//Reads everything, the buffers are checked and given back on a separate decode pool like the batch does
+static void readAll(const TestFiles& files,bool allowIoUring,u32 queueDepth,u32 bufferCount){
+    BufferPool pool(bufferCount);
+    AsyncFileReader reader(pool,queueDepth,allowIoUring);
+    if(!allowIoUring){
+        CHECK(!reader.usingIoUring());
+    }
+    std::vector<std::atomic<u32>> completions(files.paths.size());
+    std::atomic<u32> wrong(0);
+    {
+        ThreadPool consumers(2);
+        reader.readFiles(files.paths,[&](size_t index,std::vector<char>* buffer){
+            completions[index]++;
+            if(!buffer){
+                wrong += files.missing[index] ? 0 : 1;
+                return;
+            }
+            consumers.enqueue([&,index,buffer](){
+                if(files.missing[index] || *buffer != files.contents[index]){
+                    wrong++;
+                }
+                pool.release(buffer);
+            });
+        });
+        consumers.wait();
+    }
+    u32 notOnce = 0;
+    for(std::atomic<u32>& count : completions){
+        notOnce += count == 1 ? 0 : 1;
+    }
+    if(!CHECK(notOnce == 0 && wrong == 0)){
+        std::cerr << "  io_uring " << reader.usingIoUring() << " queueDepth " << queueDepth << " buffers " << bufferCount << "\n";
+    }
+    //every buffer came back
+    u32 free = 0;
+    std::vector<std::vector<char>*> taken;
+    while(std::vector<char>* buffer = pool.tryAcquire()){
+        taken.push_back(buffer);
+        free++;
+    }
+    CHECK(free == pool.size());
+    for(std::vector<char>* buffer : taken){
+        pool.release(buffer);
+    }
+}
+
+static void testBufferPool(){
+    BufferPool pool(2);
+    CHECK(pool.size() == 2);
+    std::vector<char>* first = pool.acquire();
+    std::vector<char>* second = pool.tryAcquire();
+    CHECK(first && second && first != second);
+    CHECK(pool.tryAcquire() == nullptr);
+    //abandoned buffers are replaced by a new one, not handed out again
+    pool.abandon(first);
+    std::vector<char>* replacement = pool.tryAcquire();
+    CHECK(replacement && replacement != second && pool.size() == 2);
+    pool.release(second);
+    pool.release(replacement);
+    CHECK(BufferPool(0).size() == 1);
+}
+
+int main(){
+    std::filesystem::path directory = testDirectory("pngloader-asyncreader");
+    testBufferPool();
+    TestFiles files = makeFiles(directory);
+    for(bool allowIoUring : {false,true}){
+        //queue deeper than the pool, a single read in flight, and the defaults
+        readAll(files,allowIoUring,8,3);
+        readAll(files,allowIoUring,1,1);
+        readAll(files,allowIoUring,32,64);
+    }
+    BufferPool pool(1);
+    AsyncFileReader reader(pool);
+    std::cout << "io_uring " << (reader.usingIoUring() ? "available" : "not available, only the pread fallback was tested with it") << "\n";
+    std::error_code error;
+    std::filesystem::remove_all(directory,error);
+    return testResult("AsyncReaderTests");
+}
@@ -0,0 +1,179 @@
+/*
+    Color lookup tables: the shared 8 and 16 bit tables, alpha left alone by both row kernels,
+    gAMA and iCCP chunks (and the cap on inflated profiles) and the conversion in the decoder.
+*/
+#include "TestCheck.h"
+#include "ColorProfile.h"
+#include "StreamDecoder.h"
+#include "PNGEncoder.h"
+#include "Deflater.h"
+#include <cstring>
+#include <cmath>
+
+static void testTables(){
+    ColorProfile untagged;
+    CHECK(getColorLUT(untagged,COLOR_AS_IS) == nullptr);
+    CHECK(getColorLUT(untagged,COLOR_SRGB) == nullptr);
+    std::shared_ptr<const ColorLUT> toLinear = getColorLUT(untagged,COLOR_LINEAR);
+    if(!CHECK(toLinear != nullptr)){
+        return;
+    }
+    CHECK(getColorLUT(untagged,COLOR_LINEAR) == toLinear);
+    CHECK(toLinear->lut8[0] == 0 && toLinear->lut8[255] == 255);
+    //((128/255 + 0.055)/1.055)^2.4*255 = 55.04
+    CHECK(toLinear->lut8[128] == 55);
+    const u16* table16 = toLinear->table16();
+    CHECK(table16[0] == 0 && table16[65535] == 65535);
+    u32 tableFailures = 0;
+    for(u32 v=0;v<256;v++){
+        tableFailures += std::abs((int)std::lround(table16[v*257]/257.0) - (int)toLinear->lut8[v]) > 1 ? 1 : 0;
+    }
+    CHECK(tableFailures == 0);
+
+    //a linear file gamma is already linear, 1/2.2 has to be converted to sRGB
+    ColorProfile linearGamma;
+    const u8 gammaOne[4] = {0x00,0x01,0x86,0xa0};    //100000
+    CHECK(linearGamma.readGamma(gammaOne,4));
+    CHECK(getColorLUT(linearGamma,COLOR_LINEAR) == nullptr);
+    ColorProfile gamma22;
+    const u8 gammaValue[4] = {0x00,0x00,0xb1,0x8f};  //45455
+    CHECK(gamma22.readGamma(gammaValue,4));
+    std::shared_ptr<const ColorLUT> toSRGB = getColorLUT(gamma22,COLOR_SRGB);
+    CHECK(toSRGB != nullptr && std::abs((int)toSRGB->lut8[128] - 128) <= 2);
+    //a zero gamma or a short chunk is refused
+    const u8 gammaZero[4] = {0,0,0,0};
+    ColorProfile broken;
+    CHECK(!broken.readGamma(gammaZero,4));
+    CHECK(!broken.readGamma(gammaValue,3));
+}
+
+static void testRows(){
+    ColorProfile untagged;
+    std::shared_ptr<const ColorLUT> toLinear = getColorLUT(untagged,COLOR_LINEAR);
+    if(!CHECK(toLinear != nullptr)){
+        return;
+    }
+    const u16* table16 = toLinear->table16();
+
+    //alpha is never converted, in place works too
+    u8 rgba[8] = {128,0,255,128,128,128,128,7};
+    u8 converted[8];
+    applyColorLUT(*toLinear,rgba,converted,2,4);
+    const u8 expected[8] = {55,0,255,128,55,55,55,7};
+    CHECK(std::memcmp(converted,expected,sizeof(expected)) == 0);
+    applyColorLUT(*toLinear,rgba,rgba,2,4);
+    CHECK(std::memcmp(rgba,expected,sizeof(expected)) == 0);
+    const u8 rgb[3] = {128,128,0};
+    u8 convertedRGB[3];
+    applyColorLUT(*toLinear,rgb,convertedRGB,1,3);
+    CHECK(convertedRGB[0] == 55 && convertedRGB[1] == 55 && convertedRGB[2] == 0);
+
+    //16 bit: every channel of gray and RGB, all but the last of gray and alpha and RGBA
+    const u8 samples[8] = {0x80,0x80,0x40,0x00,0x12,0x34,0xc0,0x01};
+    for(u32 channels=1;channels<=4;channels++){
+        u8 out[8];
+        applyColorLUT16(*toLinear,samples,out,1,channels);
+        bool hasAlpha = channels == 2 || channels == 4;
+        u32 mismatches = 0;
+        for(u32 c=0;c<channels;c++){
+            u32 sample = (samples[c*2] << 8) | samples[c*2+1];
+            u32 value = (hasAlpha && c == channels - 1) ? sample : table16[sample];
+            mismatches += ((u32)(out[c*2] << 8) | out[c*2+1]) != value ? 1 : 0;
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+//iCCP payload: name, null, method 0, zlib stream
+static std::vector<u8> makeICCChunk(const std::vector<u8>& profile){
+    std::vector<u8> chunk = {'t','e','s','t',0,0};
+    std::vector<u8> stream = Deflater::compressZlib(profile.data(),profile.size());
+    chunk.insert(chunk.end(),stream.begin(),stream.end());
+    return chunk;
+}
+
+static void testICC(){
+    //a profile without tags is read, one that inflates past 4MiB is refused
+    std::vector<u8> smallProfile(1000,0);
+    std::vector<u8> chunk = makeICCChunk(smallProfile);
+    ColorProfile profile;
+    CHECK(profile.readICC(chunk.data(),(u32)chunk.size()) && profile.hasICC && !profile.iccTransferFound);
+    CHECK(profile.iccName == "test");
+    std::vector<u8> hugeProfile((size_t)5 << 20,0);
+    chunk = makeICCChunk(hugeProfile);
+    CHECK(chunk.size() < ((size_t)64 << 10));
+    ColorProfile huge;
+    CHECK(!huge.readICC(chunk.data(),(u32)chunk.size()));
+    //right at the cap is still read
+    std::vector<u8> capProfile((size_t)4 << 20,0);
+    chunk = makeICCChunk(capProfile);
+    ColorProfile atCap;
+    CHECK(atCap.readICC(chunk.data(),(u32)chunk.size()));
+
+    //no name, no null inside 80 bytes, an unknown method and a broken stream
+    const u8 noName[4] = {0,0,0x78,0x9c};
+    std::vector<u8> longName(90,'a');
+    const u8 method[8] = {'t',0,1,0x78,0x9c,0,0,0};
+    const u8 corrupt[8] = {'t',0,0,0x78,0x9c,0xff,0xff,0xff};
+    ColorProfile refused;
+    CHECK(!refused.readICC(noName,4));
+    CHECK(!refused.readICC(longName.data(),(u32)longName.size()));
+    CHECK(!refused.readICC(method,8));
+    CHECK(!refused.readICC(corrupt,8));
+}
+
+//Chunk with a zero crc after IHDR, the decoder does not check chunk crcs
+static std::vector<u8> insertChunk(const std::vector<u8>& png,const char* type,const u8* data,u32 length){
+    std::vector<u8> chunk = {(u8)(length >> 24),(u8)(length >> 16),(u8)(length >> 8),(u8)length};
+    chunk.insert(chunk.end(),type,type + 4);
+    chunk.insert(chunk.end(),data,data + length);
+    chunk.insert(chunk.end(),4,0);
+    std::vector<u8> result(png.begin(),png.begin() + 33);
+    result.insert(result.end(),chunk.begin(),chunk.end());
+    result.insert(result.end(),png.begin() + 33,png.end());
+    return result;
+}
+
+static void testDecode(){
+    std::mt19937 random(37);
+    const u32 width = 19;
+    const u32 height = 7;
+    std::vector<u8> pixels((size_t)width*height*4);
+    for(u8& value : pixels){
+        value = (u8)random();
+    }
+    std::vector<u8> png;
+    if(!CHECK(encodePNG(pixels.data(),width,height,6,png))){
+        return;
+    }
+    //a linear light file decoded to sRGB, alpha untouched
+    const u8 gammaOne[4] = {0x00,0x01,0x86,0xa0};
+    std::vector<u8> tagged = insertChunk(png,"gAMA",gammaOne,4);
+    ColorProfile profile;
+    profile.readGamma(gammaOne,4);
+    std::shared_ptr<const ColorLUT> toSRGB = getColorLUT(profile,COLOR_SRGB);
+    if(!CHECK(toSRGB != nullptr)){
+        return;
+    }
+    std::vector<u8> decoded;
+    ImageHeader header;
+    CHECK(decodePixels(tagged.data(),tagged.size(),decoded,header,COLOR_AS_IS) && decoded == pixels);
+    CHECK(decodePixels(tagged.data(),tagged.size(),decoded,header,COLOR_LINEAR) && decoded == pixels);
+    CHECK(decodePixels(tagged.data(),tagged.size(),decoded,header,COLOR_SRGB));
+    std::vector<u8> expected(pixels.size());
+    applyColorLUT(*toSRGB,pixels.data(),expected.data(),(size_t)width*height,4);
+    CHECK(decoded == expected);
+
+    //a broken color chunk only loses the correction
+    const u8 gammaZero[4] = {0,0,0,0};
+    std::vector<u8> broken = insertChunk(png,"gAMA",gammaZero,4);
+    CHECK(decodePixels(broken.data(),broken.size(),decoded,header,COLOR_SRGB) && decoded == pixels);
+}
+
+int main(){
+    testTables();
+    testRows();
+    testICC();
+    testDecode();
+    return testResult("ColorTests");
+}
@@ -0,0 +1,149 @@
+/*
+    PNGEncoder output read back by the decoder: serial and banded parallel encodes of both color types,
+    filterScanline undone by defilterScanline, Deflater round trips and the inputs the encoder refuses.
+*/
+#include "TestCheck.h"
+#include "PNGEncoder.h"
+#include "StreamDecoder.h"
+#include "Defilter.h"
+#include <cstring>
+
+//smooth gradients with noise so every filter type gets picked
+static std::vector<u8> makePixels(u32 width,u32 height,u32 pixelBytes,std::mt19937& random){
+    std::vector<u8> pixels((size_t)width*height*pixelBytes);
+    for(size_t i=0;i<pixels.size();i++){
+        pixels[i] = (u8)((i % (width*pixelBytes))*3 + (i/(width*pixelBytes))*5 + random() % 4);
+    }
+    return pixels;
+}
+
+static void testRoundTrip(){
+    std::mt19937 random(11);
+    const u32 width = 37;
+    const u32 height = 23;
+    const u8 colorTypes[2] = {2,6};
+    for(u8 colorType : colorTypes){
+        std::vector<u8> pixels = makePixels(width,height,colorType == 6 ? 4 : 3,random);
+        std::vector<u8> serial;
+        CHECK(encodePNG(pixels.data(),width,height,colorType,serial));
+        //bands that dont divide the height, one row per band and more threads than bands
+        const u32 bandRows[3] = {5,1,0};
+        const u32 threadCounts[2] = {4,0};
+        for(u32 rows : bandRows){
+            for(u32 threadCount : threadCounts){
+                EncoderOptions options;
+                options.threadCount = threadCount;
+                options.bandRows = rows;
+                std::vector<u8> png;
+                if(!CHECK(encodePNG(pixels.data(),width,height,colorType,png,options))){
+                    continue;
+                }
+                std::vector<u8> decoded;
+                ImageHeader header;
+                CHECK(decodePixels(png.data(),png.size(),decoded,header));
+                CHECK(header.width == width && header.height == height && header.colorType == colorType && header.bpp == 8);
+                CHECK(decoded == pixels);
+            }
+        }
+        std::vector<u8> decoded;
+        ImageHeader header;
+        CHECK(decodePixels(serial.data(),serial.size(),decoded,header) && decoded == pixels);
+    }
+
+    //a single pixel, and a flat image that compresses to almost nothing
+    const u8 pixel[4] = {1,2,3,4};
+    std::vector<u8> png;
+    std::vector<u8> decoded;
+    ImageHeader header;
+    CHECK(encodePNG(pixel,1,1,6,png) && decodePixels(png.data(),png.size(),decoded,header));
+    CHECK(decoded == std::vector<u8>(pixel,pixel + 4));
+    std::vector<u8> flat((size_t)512*512*3,77);
+    CHECK(encodePNG(flat.data(),512,512,2,png) && png.size() < flat.size()/100);
+    CHECK(decodePixels(png.data(),png.size(),decoded,header) && decoded == flat);
+}
+
+static void testFilters(){
+    std::mt19937 random(2);
+    const u32 pixelBytesList[2] = {3,4};
+    for(u32 pixelBytes : pixelBytesList){
+        const size_t rowBytes = 21*pixelBytes;
+        std::vector<u8> rows = makePixels(21,6,pixelBytes,random);
+        std::vector<u8> filtered(rowBytes + 1);
+        std::vector<u8> restored(rowBytes);
+        u32 mismatches = 0;
+        for(u32 y=0;y<6;y++){
+            const u8* row = rows.data() + y*rowBytes;
+            const u8* prevRow = y > 0 ? row - rowBytes : nullptr;
+            u8 filterType = filterScanline(row,prevRow,rowBytes,pixelBytes,filtered.data());
+            mismatches += (filterType > 4 || filterType != filtered[0]) ? 1 : 0;
+            defilterScanline(filtered.data() + 1,filterType,prevRow,restored.data(),rowBytes,pixelBytes);
+            mismatches += std::vector<u8>(row,row + rowBytes) != restored ? 1 : 0;
+        }
+        CHECK(mismatches == 0);
+    }
+    //a constant row is best left as it is, a ramp as the difference to its neighbour
+    std::vector<u8> constant(30,0);
+    std::vector<u8> filtered(31);
+    CHECK(filterScanline(constant.data(),nullptr,30,3,filtered.data()) == 0);
+    std::vector<u8> ramp(30);
+    for(u32 i=0;i<30;i++){
+        ramp[i] = (u8)(100 + i/3*9);
+    }
+    CHECK(filterScanline(ramp.data(),nullptr,30,3,filtered.data()) == 1);
+}
+
+static void testDeflater(){
+    std::mt19937 random(9);
+    //random bytes dont compress and go into stored blocks, the text does
+    std::vector<u8> noise(70000);
+    for(u8& value : noise){
+        value = (u8)random();
+    }
+    std::vector<u8> text;
+    for(u32 i=0;i<5000;i++){
+        const char* word = (i % 3 == 0) ? "png " : (i % 5 == 0 ? "deflate " : "huffman ");
+        text.insert(text.end(),word,word + std::strlen(word));
+    }
+    DeflateOptions fast;
+    fast.maxChainLength = 1;
+    fast.niceLength = 8;
+    for(const std::vector<u8>* data : {&noise,&text}){
+        for(const DeflateOptions& options : {DeflateOptions(),fast}){
+            std::vector<u8> compressed = Deflater::compressZlib(data->data(),data->size(),options);
+            std::vector<u8> output;
+            Inflater inflater([&output](const u8* bytes,size_t size){
+                output.insert(output.end(),bytes,bytes + size);
+            });
+            CHECK(inflater.feed(compressed.data(),compressed.size()) == Inflater::INFLATE_DONE && output == *data);
+            if(data == &noise){
+                CHECK(compressed.size() < noise.size() + noise.size()/1000 + 64);
+            }else{
+                CHECK(compressed.size() < text.size()/4);
+            }
+        }
+    }
+    std::vector<u8> empty = Deflater::compressZlib(nullptr,0);
+    std::vector<u8> output;
+    Inflater inflater([&output](const u8* bytes,size_t size){
+        output.insert(output.end(),bytes,bytes + size);
+    });
+    CHECK(inflater.feed(empty.data(),empty.size()) == Inflater::INFLATE_DONE && output.empty());
+}
+
+static void testRejected(){
+    std::vector<u8> pixels(16,0);
+    std::vector<u8> png;
+    //grayscale, palette and empty images
+    CHECK(!encodePNG(pixels.data(),2,2,0,png));
+    CHECK(!encodePNG(pixels.data(),2,2,3,png));
+    CHECK(!encodePNG(pixels.data(),0,2,2,png));
+    CHECK(!encodePNG(pixels.data(),2,0,6,png));
+}
+
+int main(){
+    testRoundTrip();
+    testFilters();
+    testDeflater();
+    testRejected();
+    return testResult("EncoderTests");
+}
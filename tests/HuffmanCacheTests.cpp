@@ -0,0 +1,167 @@
+/*
+    HuffmanTableCache hits, misses, evictions and key collisions, and HuffmanTree::decodeLE
+    checked against a bit by bit canonical decode for codes inside and past the lookup table.
+*/
+#include "TestCheck.h"
+#include "HuffmanTableCache.h"
+#include <algorithm>
+
+//255 codes of 8 bits and 2 of 9 bits for hLit 257, then two 1 bit distance codes
+static std::vector<u32> makeLengths(u32 longSymbol){
+    std::vector<u32> lengths(257 + 2,8);
+    lengths[255] = 9;
+    lengths[256] = 9;
+    std::swap(lengths[255],lengths[longSymbol]);
+    lengths[257] = 1;
+    lengths[258] = 1;
+    return lengths;
+}
+
+static void testCacheStats(){
+    HuffmanTableCache cache(256);
+    std::vector<u32> first = makeLengths(0);
+    std::vector<u32> second = makeLengths(1);
+    std::shared_ptr<const HuffmanTables> tables = cache.get(first.data(),257,2);
+    CHECK(tables && tables->hLit == 257 && tables->literalTree.maxBit == 9 && tables->distanceTree.maxBit == 1);
+    CHECK(cache.get(first.data(),257,2) == tables);
+    CHECK(cache.get(second.data(),257,2) != tables);
+    HuffmanCacheStats stats = cache.getStats();
+    CHECK(stats.hits == 1 && stats.misses == 2 && stats.evictions == 0 && stats.collisions == 0);
+    CHECK(stats.hitRate() > 0.33 && stats.hitRate() < 0.34);
+
+    //the same key for other lengths is rebuilt and replaces the entry
+    CHECK(cache.get(7,first.data(),257,2) != nullptr);
+    std::shared_ptr<const HuffmanTables> replaced = cache.get(7,second.data(),257,2);
+    CHECK(replaced && replaced->codeLengths[1] == 9);
+    CHECK(cache.get(7,second.data(),257,2) == replaced);
+    stats = cache.getStats();
+    CHECK(stats.collisions == 1 && stats.hits == 2 && stats.misses == 4);
+
+    //lengths that oversubscribe the code space are not cached
+    std::vector<u32> invalid(259,1);
+    CHECK(cache.get(invalid.data(),257,2) == nullptr);
+    CHECK(cache.get(invalid.data(),257,2) == nullptr);
+    CHECK(cache.getStats().hits == 2);
+}
+
+static void testCapacity(){
+    //capacity 0 builds every header
+    HuffmanTableCache off(0);
+    std::vector<u32> lengths = makeLengths(0);
+    std::shared_ptr<const HuffmanTables> tables = off.get(lengths.data(),257,2);
+    CHECK(tables && off.get(lengths.data(),257,2) != tables);
+    HuffmanCacheStats stats = off.getStats();
+    CHECK(stats.hits == 0 && stats.misses == 2 && stats.evictions == 0);
+
+    //one entry per shard, 255 headers cant all stay
+    HuffmanTableCache small(16);
+    for(u32 symbol=0;symbol<255;symbol++){
+        lengths = makeLengths(symbol);
+        small.get(lengths.data(),257,2);
+    }
+    stats = small.getStats();
+    CHECK(stats.misses == 255 && stats.evictions >= 255 - 16);
+    //evicted tables stay valid while they are held
+    CHECK(tables->literalTree.symbols.size() == 257);
+
+    //shrinking trims right away
+    HuffmanTableCache shrinking(256);
+    for(u32 symbol=0;symbol<64;symbol++){
+        lengths = makeLengths(symbol);
+        shrinking.get(lengths.data(),257,2);
+    }
+    shrinking.setCapacity(0);
+    CHECK(shrinking.getStats().evictions == 64);
+}
+
+//canonical codes written in stream order (first code bit lowest) for every symbol
+static void testDecode(const std::vector<u32>& lengths,std::mt19937& random){
+    HuffmanTree tree;
+    if(!CHECK(tree.buildFromCodeLengths(lengths.data(),(u32)lengths.size()))){
+        return;
+    }
+    u32 count[16] = {};
+    for(u32 length : lengths){
+        count[length]++;
+    }
+    count[0] = 0;
+    u32 next[16] = {};
+    u32 code = 0;
+    for(u32 length=1;length<16;length++){
+        code = (code + count[length-1]) << 1;
+        next[length] = code;
+    }
+    u32 mismatches = 0;
+    for(u32 symbol=0;symbol<lengths.size();symbol++){
+        u32 length = lengths[symbol];
+        if(length == 0){
+            continue;
+        }
+        u32 canonical = next[length]++;
+        u32 bits = 0;
+        for(u32 i=0;i<length;i++){
+            bits |= ((canonical >> (length - 1 - i)) & 1) << i;
+        }
+        //whatever follows the code must not change it
+        u32 stream = bits | (u32)(random() << length);
+        u32 bitlength = 0;
+        mismatches += (tree.decodeLE(stream,32,bitlength) != symbol || bitlength != length) ? 1 : 0;
+        mismatches += (tree.decodeLE(bits,length,bitlength) != symbol || bitlength != length) ? 1 : 0;
+        //one bit short
+        mismatches += tree.decodeLE(bits,length - 1,bitlength) != HUFFMAN_NEED_BITS ? 1 : 0;
+    }
+    CHECK(mismatches == 0);
+}
+
+static void testTreeDecode(){
+    std::mt19937 random(35);
+    //one code of every length up to 15, half of them past the table
+    std::vector<u32> ladder;
+    for(u32 length=1;length<=15;length++){
+        ladder.push_back(length);
+    }
+    ladder.push_back(15);
+    testDecode(ladder,random);
+
+    //the fixed literal/length code and random complete codes with unused symbols
+    std::vector<u32> fixed(288,8);
+    std::fill(fixed.begin() + 144,fixed.begin() + 256,9);
+    std::fill(fixed.begin() + 256,fixed.begin() + 280,7);
+    testDecode(fixed,random);
+    for(u32 round=0;round<20;round++){
+        //split random leaves until there are enough symbols, then shuffle them over the alphabet
+        std::vector<u32> leaves(1,0);
+        u32 target = 2 + random() % 280;
+        while(leaves.size() < target){
+            size_t pick = random() % leaves.size();
+            if(leaves[pick] == 15){
+                continue;
+            }
+            leaves[pick]++;
+            leaves.push_back(leaves[pick]);
+        }
+        leaves.resize(286,0);
+        std::shuffle(leaves.begin(),leaves.end(),random);
+        testDecode(leaves,random);
+    }
+
+    //a lone 1 bit code leaves the other bit unused
+    std::vector<u32> lone(5,0);
+    lone[3] = 1;
+    HuffmanTree tree;
+    u32 bitlength = 0;
+    CHECK(tree.buildFromCodeLengths(lone.data(),5));
+    CHECK(tree.decodeLE(0,1,bitlength) == 3 && bitlength == 1);
+    CHECK(tree.decodeLE(1,1,bitlength) == HUFFMAN_INVALID_CODE);
+    //no codes at all
+    std::vector<u32> none(30,0);
+    CHECK(tree.buildFromCodeLengths(none.data(),30));
+    CHECK(tree.decodeLE(0,32,bitlength) == HUFFMAN_INVALID_CODE);
+}
+
+int main(){
+    testCacheStats();
+    testCapacity();
+    testTreeDecode();
+    return testResult("HuffmanCacheTests");
+}
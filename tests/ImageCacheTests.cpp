@@ -0,0 +1,180 @@
+/*
+    ImageCache eviction, spilling and key collisions, decodeCached and decodeBatch through a cache
+    and decodePixels on headers over the image byte limit.
+*/
+#include "TestCheck.h"
+#include "CachedDecoder.h"
+#include "PNGEncoder.h"
+#include <atomic>
+#include <cstring>
+
+static CachedImage makeImage(u32 width,u32 height,u8 fill){
+    std::shared_ptr<std::vector<u8>> pixels = std::make_shared<std::vector<u8>>((size_t)width*height*3,fill);
+    CachedImage image;
+    image.width = width;
+    image.height = height;
+    image.size = pixels->size();
+    image.pixels = std::shared_ptr<const u8>(pixels,pixels->data());
+    return image;
+}
+
+static void testMemory(){
+    CachedImage image;
+    //room for two 300 byte images
+    ImageCache cache(600);
+    cache.insert(1,7,makeImage(10,10,1));
+    cache.insert(2,7,makeImage(10,10,2));
+    CHECK(cache.lookup(1,7,image) && image.pixels.get()[0] == 1);
+    //2 is now the least recently used
+    cache.insert(3,7,makeImage(10,10,3));
+    CHECK(!cache.lookup(2,7,image));
+    CHECK(cache.lookup(1,7,image) && cache.lookup(3,7,image));
+    CacheStats stats = cache.getStats();
+    CHECK(stats.evictions == 1 && stats.spills == 0 && stats.bytesUsed == 600);
+    CHECK(stats.hits == 3 && stats.misses == 1);
+    //larger than the whole budget, still kept until the next insert
+    cache.insert(4,7,makeImage(20,20,4));
+    CHECK(cache.lookup(4,7,image) && image.size == 1200);
+    CHECK(cache.getStats().evictions == 3);
+}
+
+static void testCollisions(){
+    CachedImage image;
+    ImageCache cache(1000);
+    cache.insert(1,100,makeImage(10,10,1));
+    //same key from a different source
+    CHECK(!cache.lookup(1,200,image));
+    CHECK(cache.getStats().collisions == 1 && cache.getStats().misses == 1);
+    //which then replaces the entry instead of adding to it
+    cache.insert(1,200,makeImage(10,10,2));
+    CHECK(cache.getStats().bytesUsed == 300);
+    CHECK(!cache.lookup(1,100,image));
+    CHECK(cache.lookup(1,200,image) && image.pixels.get()[0] == 2);
+    CHECK(cache.getStats().collisions == 2 && cache.getStats().hits == 1);
+}
+
+static void testSpill(const std::filesystem::path& directory){
+    CachedImage image;
+    //room for two blobs (24 byte header + 300 bytes) on disk
+    const u64 blobSize = 24 + 300;
+    {
+        ImageCache cache(600,directory.string(),blobSize*2 + 10);
+        cache.insert(1,7,makeImage(10,10,1));
+        cache.insert(2,7,makeImage(10,10,2));
+        cache.insert(3,7,makeImage(10,10,3));   //1 spills
+        CHECK(cache.getStats().spills == 1);
+        CHECK(cache.lookup(1,7,image) && image.width == 10 && image.channels == 3 && image.pixels.get()[299] == 1);  //2 spills
+        cache.insert(4,7,makeImage(10,10,4));   //3 spills, 1 is the oldest blob and goes
+        CacheStats stats = cache.getStats();
+        CHECK(stats.spillHits == 1 && stats.spills == 3);
+        CHECK(stats.spillRemovals == 1 && stats.spillBytesUsed == blobSize*2);
+        CHECK(cache.lookup(2,7,image) && image.pixels.get()[0] == 2);
+    }
+    size_t blobCount = 0;
+    std::error_code error;
+    for(const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(directory,error)){
+        blobCount += file.path().extension() == ".raw" ? 1 : 0;
+    }
+    CHECK(blobCount == 2);
+    {
+        //a new cache picks up the blobs of the earlier one, and checks them
+        ImageCache cache(600,directory.string(),blobSize*2 + 10);
+        CHECK(cache.getStats().spillBytesUsed == blobSize*2);
+        CHECK(!cache.lookup(3,8,image));
+        CHECK(cache.getStats().collisions == 1);
+        CHECK(cache.lookup(3,7,image) && image.pixels.get()[0] == 3);
+        CHECK(!cache.lookup(1,7,image));
+    }
+}
+
+static void testDecodeCached(const std::filesystem::path& directory){
+    std::vector<std::string> filepaths;
+    std::vector<std::vector<u8>> expected;
+    for(u32 i=0;i<12;i++){
+        u32 width = 3 + i;
+        u8 colorType = i % 2 ? 6 : 2;
+        std::vector<u8> pixels((size_t)width*4*(colorType == 6 ? 4 : 3));
+        for(size_t p=0;p<pixels.size();p++){
+            pixels[p] = (u8)(p*7 + i);
+        }
+        std::vector<u8> png;
+        CHECK(encodePNG(pixels.data(),width,4,colorType,png));
+        std::string path = (directory / ("image" + std::to_string(i) + ".png")).string();
+        CHECK(writeTestFile(path,png.data(),png.size()));
+        filepaths.push_back(path);
+        expected.push_back(pixels);
+    }
+    filepaths.push_back((directory / "missing.png").string());
+
+    ImageCache cache(1 << 20);
+    std::atomic<u32> matching(0);
+    auto compare = [&](size_t index,const CachedImage& image){
+        if(image.size == expected[index].size() && std::memcmp(image.pixels.get(),expected[index].data(),image.size) == 0){
+            matching++;
+        }
+    };
+    CHECK(decodeBatch(filepaths,cache,compare,4) == 12 && matching == 12);
+    CHECK(cache.getStats().misses == 12 && cache.getStats().hits == 0);
+    //everything is a hit the second time
+    matching = 0;
+    CHECK(decodeBatch(filepaths,cache,compare,4) == 12 && matching == 12);
+    CHECK(cache.getStats().hits == 12);
+
+    //identity keys and color output get their own entries
+    CachedImage image;
+    CachedDecodeOptions options;
+    options.keyByContent = false;
+    CHECK(decodeCached(filepaths[1],cache,image,options) && image.channels == 4 && image.width == 4);
+    CHECK(decodeCached(filepaths[1],cache,image,options) && cache.getStats().hits == 13);
+    options.colorOutput = COLOR_LINEAR;
+    u64 misses = cache.getStats().misses;
+    CHECK(decodeCached(filepaths[1],cache,image,options) && cache.getStats().misses == misses + 1);
+
+    //an image over the limit fails instead of being decoded
+    options = CachedDecodeOptions();
+    options.maxImageBytes = 16;
+    ImageCache small(1 << 20);
+    CHECK(!decodeCached(filepaths[0],small,image,options));
+}
+
+//IHDR patched to claim a huge image, the crc is not checked
+static std::vector<u8> withSize(const std::vector<u8>& png,u32 width,u32 height){
+    std::vector<u8> patched = png;
+    const u8 size[8] = {(u8)(width >> 24),(u8)(width >> 16),(u8)(width >> 8),(u8)width,
+                        (u8)(height >> 24),(u8)(height >> 16),(u8)(height >> 8),(u8)height};
+    std::memcpy(&patched[16],size,8);
+    return patched;
+}
+
+static void testDecodeLimits(){
+    std::vector<u8> pixels(8*8*3,50);
+    std::vector<u8> png;
+    CHECK(encodePNG(pixels.data(),8,8,2,png));
+    std::vector<u8> decoded;
+    ImageHeader header;
+    CHECK(decodePixels(png.data(),png.size(),decoded,header) && decoded == pixels);
+    //exactly at the limit and one byte under it
+    CHECK(decodePixels(png.data(),png.size(),decoded,header,COLOR_AS_IS,8*8*3));
+    CHECK(!decodePixels(png.data(),png.size(),decoded,header,COLOR_AS_IS,8*8*3 - 1));
+
+    //(2^31-1)^2*3 and 100000^2*3 bytes, both fail at IHDR without touching the allocator
+    std::vector<u8> huge = withSize(png,0x7fffffff,0x7fffffff);
+    CHECK(!decodePixels(huge.data(),huge.size(),decoded,header));
+    CHECK(decoded.capacity() < ((size_t)1 << 20));
+    huge = withSize(png,100000,100000);
+    //allowed by the limit, only the rows that decode are stored before the data runs out
+    CHECK(!decodePixels(huge.data(),huge.size(),decoded,header,COLOR_AS_IS,~0ull) && decoded.size() < (size_t)100000*3*8);
+    CHECK(!decodePixels(huge.data(),huge.size(),decoded,header));
+}
+
+int main(){
+    std::filesystem::path directory = testDirectory("pngloader-cache");
+    testMemory();
+    testCollisions();
+    testSpill(directory / "spill");
+    testDecodeCached(directory);
+    testDecodeLimits();
+    std::error_code error;
+    std::filesystem::remove_all(directory,error);
+    return testResult("ImageCacheTests");
+}
@@ -0,0 +1,199 @@
+/*
+    Differential test of the Inflater against system zlib.
+    Every stream is inflated by zlib and by the Inflater, once in one piece and once
+    in random slices (resume points anywhere, even inside a huffman code), and the
+    outputs have to match byte for byte. Streams zlib rejects must not finish in the Inflater.
+    Streams: the IDAT data of every png given on the command line, zlib compressions of
+    generated data at every level and strategy (zlib and raw deflate) and corrupted copies of those.
+*/
+#include "Inflater.h"
+#include <zlib.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <random>
+
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+struct Result{
+    bool ok=false;
+    std::vector<u8> output;
+};
+
+static Result zlibInflate(const std::vector<u8>& input,bool zlibStream){
+    Result result;
+    z_stream stream;
+    std::memset(&stream,0,sizeof(stream));
+    if(inflateInit2(&stream,zlibStream ? 15 : -15) != Z_OK){
+        return result;
+    }
+    stream.next_in = (Bytef*)input.data();
+    stream.avail_in = (uInt)input.size();
+    u8 chunk[65536];
+    int status = Z_OK;
+    while(status == Z_OK){
+        stream.next_out = chunk;
+        stream.avail_out = sizeof(chunk);
+        status = inflate(&stream,Z_NO_FLUSH);
+        result.output.insert(result.output.end(),chunk,chunk + (sizeof(chunk) - stream.avail_out));
+        if(status == Z_BUF_ERROR && stream.avail_in == 0){
+            break;
+        }
+    }
+    result.ok = status == Z_STREAM_END;
+    inflateEnd(&stream);
+    return result;
+}
+
+//sliceSize 0 feeds everything at once, otherwise slices of 1 to sliceSize bytes
+static Result inflaterInflate(const std::vector<u8>& input,bool zlibStream,u32 sliceSize,std::mt19937& random){
+    Result result;
+    Inflater inflater([&result](const u8* data,size_t size){
+        result.output.insert(result.output.end(),data,data + size);
+    },zlibStream);
+    size_t offset = 0;
+    Inflater::Status status = Inflater::INFLATE_NEED_INPUT;
+    while(status == Inflater::INFLATE_NEED_INPUT && offset < input.size()){
+        size_t count = input.size() - offset;
+        if(sliceSize){
+            count = std::min<size_t>(count,1 + random() % sliceSize);
+        }
+        status = inflater.feed(input.data() + offset,count);
+        offset += count;
+    }
+    result.ok = status == Inflater::INFLATE_DONE && inflater.finished();
+    return result;
+}
+
+static u32 failures = 0;
+static u32 streams = 0;
+
+static void compare(const std::vector<u8>& input,bool zlibStream,const std::string& name,std::mt19937& random,bool mustSucceed){
+    Result expected = zlibInflate(input,zlibStream);
+    streams++;
+    if(mustSucceed && !expected.ok){
+        std::cerr << name << ": zlib could not inflate the stream\n";
+        failures++;
+        return;
+    }
+    const u32 sliceSizes[3] = {0,1,4096};
+    for(u32 sliceSize : sliceSizes){
+        Result actual = inflaterInflate(input,zlibStream,sliceSize,random);
+        bool match = expected.ok ? (actual.ok && actual.output == expected.output) : !actual.ok;
+        if(!match){
+            std::cerr << name << " (slices of up to " << sliceSize << " bytes): zlib " << (expected.ok ? "inflated " : "rejected the stream, ")
+                      << expected.output.size() << " bytes, Inflater " << (actual.ok ? "finished with " : "stopped after ")
+                      << actual.output.size() << " bytes\n";
+            failures++;
+        }
+    }
+}
+
+static bool readFile(const std::string& path,std::vector<u8>& data){
+    std::ifstream file(path,std::ios::binary);
+    if(!file){
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file),std::istreambuf_iterator<char>());
+    return true;
+}
+
+static u32 readBigEndian32(const u8* data){
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | (u32)data[3];
+}
+
+//Concatenated IDAT data of a png, empty if the file isnt one
+static std::vector<u8> imageData(const std::vector<u8>& png){
+    std::vector<u8> data;
+    size_t offset = 8;
+    while(offset + 12 <= png.size()){
+        u32 length = readBigEndian32(&png[offset]);
+        if(length > png.size() - offset - 12){
+            break;
+        }
+        if(std::memcmp(&png[offset + 4],"IDAT",4) == 0){
+            data.insert(data.end(),png.begin() + offset + 8,png.begin() + offset + 8 + length);
+        }
+        offset += 12 + (size_t)length;
+    }
+    return data;
+}
+
+static std::vector<u8> zlibCompress(const std::vector<u8>& input,int level,int strategy,bool zlibStream){
+    z_stream stream;
+    std::memset(&stream,0,sizeof(stream));
+    deflateInit2(&stream,level,Z_DEFLATED,zlibStream ? 15 : -15,8,strategy);
+    std::vector<u8> output(deflateBound(&stream,(uLong)input.size()));
+    stream.next_in = (Bytef*)input.data();
+    stream.avail_in = (uInt)input.size();
+    stream.next_out = output.data();
+    stream.avail_out = (uInt)output.size();
+    deflate(&stream,Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+//Text like data with long repeats, runs and noise so every block type and match length shows up
+static std::vector<u8> generateData(size_t size,std::mt19937& random){
+    std::vector<u8> data;
+    data.reserve(size);
+    while(data.size() < size){
+        u32 kind = random() % 4;
+        u32 length = 1 + random() % 300;
+        if(kind == 0 || data.size() < 4){
+            for(u32 i=0;i<length;i++)data.push_back((u8)random());
+        }else if(kind == 1){
+            u8 value = (u8)random();
+            for(u32 i=0;i<length;i++)data.push_back(value);
+        }else{
+            //repeat from up to 32KiB back
+            size_t distance = 1 + random() % std::min<size_t>(data.size(),32768);
+            for(u32 i=0;i<length;i++)data.push_back(data[data.size() - distance]);
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+int main(int argc,char* argv[]){
+    std::mt19937 random(12345);
+    for(int i=1;i<argc;i++){
+        std::vector<u8> png;
+        if(!readFile(argv[i],png)){
+            std::cerr << "Failed to open " << argv[i] << "\n";
+            failures++;
+            continue;
+        }
+        compare(imageData(png),true,argv[i],random,true);
+    }
+
+    const int strategies[5] = {Z_DEFAULT_STRATEGY,Z_FILTERED,Z_HUFFMAN_ONLY,Z_RLE,Z_FIXED};
+    const size_t sizes[4] = {0,1,1000,200000};
+    for(size_t size : sizes){
+        std::vector<u8> data = generateData(size,random);
+        for(int level=0;level<=9;level++){
+            for(int strategy : strategies){
+                for(int zlibStream=0;zlibStream<2;zlibStream++){
+                    std::vector<u8> compressed = zlibCompress(data,level,strategy,zlibStream != 0);
+                    std::string name = "generated " + std::to_string(size) + " bytes, level " + std::to_string(level) +
+                                       ", strategy " + std::to_string(strategy) + (zlibStream ? " zlib" : " raw");
+                    compare(compressed,zlibStream != 0,name,random,true);
+                    //single byte corruptions, zlib decides whether the result is still valid
+                    if(compressed.size() > 2 && size <= 1000){
+                        for(u32 k=0;k<8;k++){
+                            std::vector<u8> corrupt = compressed;
+                            corrupt[random() % corrupt.size()] ^= (u8)(1 + random() % 255);
+                            compare(corrupt,zlibStream != 0,name + " corrupted",random,false);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::cout << streams << " streams compared, " << failures << " mismatches\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/*
+    decodeToFile into a mapped and a streamed output compared with decodePixels,
+    on images encoded in many independent bands and on the res images,
+    and the header limits that stop a decode before anything is allocated.
+*/
+#include "TestCheck.h"
+#include "OutOfCore.h"
+#include "PNGEncoder.h"
+#include "Parser.h"
+#include <cstring>
+
+//Reads a binary ppm back as rgb, false if the header is not width x height
+static bool readPPM(const std::filesystem::path& path,u32 width,u32 height,std::vector<u8>& rgb){
+    std::ifstream ifs(path,std::ios::binary);
+    std::string magic;
+    u32 fileWidth = 0;
+    u32 fileHeight = 0;
+    u32 maxValue = 0;
+    if(!(ifs >> magic >> fileWidth >> fileHeight >> maxValue) || magic != "P6" || fileWidth != width || fileHeight != height || maxValue != 255){
+        return false;
+    }
+    ifs.get();
+    rgb.assign((size_t)width*height*3,0);
+    return ifs.read((char*)rgb.data(),rgb.size()) && ifs.peek() == EOF;
+}
+
+static std::vector<u8> dropAlpha(const std::vector<u8>& pixels,u32 pixelBytes){
+    if(pixelBytes == 3){
+        return pixels;
+    }
+    std::vector<u8> rgb(pixels.size()/4*3);
+    for(size_t i=0;i<pixels.size()/4;i++){
+        std::memcpy(&rgb[i*3],&pixels[i*4],3);
+    }
+    return rgb;
+}
+
+//Both outputs of decodeToFile have to match decodePixels with alpha dropped
+static void compareWithDecodePixels(const std::filesystem::path& directory,const std::string& inputPath){
+    std::vector<char> buffer;
+    if(!CHECK(Parser().readFile(inputPath,buffer))){
+        return;
+    }
+    std::vector<u8> pixels;
+    ImageHeader header;
+    if(!CHECK(decodePixels((const u8*)buffer.data(),buffer.size(),pixels,header))){
+        return;
+    }
+    std::vector<u8> expected = dropAlpha(pixels,header.colorType == 6 ? 4 : 3);
+    for(bool mapped : {true,false}){
+        std::filesystem::path output = directory / (mapped ? "mapped.ppm" : "streamed.ppm");
+        std::vector<u8> rgb;
+        CHECK(decodeToFile(inputPath,output.string(),mapped));
+        CHECK(readPPM(output,header.width,header.height,rgb) && rgb == expected);
+    }
+}
+
+static void testBands(const std::filesystem::path& directory){
+    std::mt19937 random(4);
+    //more than a page per row so the mapped output releases pages while decoding
+    const u32 width = 1500;
+    const u32 height = 301;
+    const u8 colorTypes[2] = {2,6};
+    for(u8 colorType : colorTypes){
+        u32 pixelBytes = colorType == 6 ? 4 : 3;
+        std::vector<u8> pixels((size_t)width*height*pixelBytes);
+        for(size_t i=0;i<pixels.size();i++){
+            pixels[i] = (u8)((i/pixelBytes % width)/6 + (i/(width*pixelBytes))*2 + random() % 8);
+        }
+        //a band every 16 rows, each one its own deflate part with a full flush
+        EncoderOptions options;
+        options.threadCount = 4;
+        options.bandRows = 16;
+        std::vector<u8> png;
+        CHECK(encodePNG(pixels.data(),width,height,colorType,png,options));
+        std::filesystem::path input = directory / "bands.png";
+        CHECK(writeTestFile(input,png.data(),png.size()));
+        compareWithDecodePixels(directory,input.string());
+    }
+}
+
+//IHDR patched to another size, the crc is not checked
+static void writeWithSize(const std::filesystem::path& path,const std::vector<u8>& png,u32 width,u32 height){
+    std::vector<u8> patched = png;
+    const u8 size[8] = {(u8)(width >> 24),(u8)(width >> 16),(u8)(width >> 8),(u8)width,
+                        (u8)(height >> 24),(u8)(height >> 16),(u8)(height >> 8),(u8)height};
+    std::memcpy(&patched[16],size,8);
+    CHECK(writeTestFile(path,patched.data(),patched.size()));
+}
+
+static void testLimits(const std::filesystem::path& directory){
+    std::vector<u8> pixels(64*4*3,9);
+    std::vector<u8> png;
+    CHECK(encodePNG(pixels.data(),64,4,2,png));
+    std::filesystem::path input = directory / "limits.png";
+    std::string output = (directory / "limits.ppm").string();
+    CHECK(writeTestFile(input,png.data(),png.size()));
+    DecodeLimits limits;
+    limits.maxRowBytes = 64*3;
+    CHECK(decodeToFile(input.string(),output,true,limits));
+    limits.maxRowBytes = 64*3 - 1;
+    CHECK(!decodeToFile(input.string(),output,true,limits));
+
+    //over the spec limit, and rows over the default row limit, fail before an output exists
+    const u32 sizes[3][2] = {{0x80000000u,1},{1,0x80000000u},{0x7fffffff,0x7fffffff}};
+    for(const auto& size : sizes){
+        writeWithSize(input,png,size[0],size[1]);
+        std::filesystem::remove(output);
+        CHECK(!decodeToFile(input.string(),output,true));
+        CHECK(!std::filesystem::exists(output));
+    }
+    //allowed, the output gets created and the missing rows make it fail
+    writeWithSize(input,png,64,100000);
+    CHECK(!decodeToFile(input.string(),output,false));
+}
+
+int main(int argc,char* argv[]){
+    std::filesystem::path directory = testDirectory("pngloader-outofcore");
+    testBands(directory);
+    testLimits(directory);
+    if(argc >= 2){
+        compareWithDecodePixels(directory,std::string(argv[1]) + "/dbh.png");
+        compareWithDecodePixels(directory,std::string(argv[1]) + "/demon.png");
+    }
+    std::error_code error;
+    std::filesystem::remove_all(directory,error);
+    return testResult("OutOfCoreTests");
+}
@@ -0,0 +1,123 @@
+/*
+    Parser::probe and Parser::probeBatch on valid, truncated, non png and missing files.
+    argv[1] is the res directory, its images are probed for their known sizes.
+*/
+#include "TestCheck.h"
+#include "Parser.h"
+#include "PNGEncoder.h"
+#include <cstring>
+
+static std::string path(const std::filesystem::path& directory,const char* name){
+    return (directory / name).string();
+}
+
+static void testProbe(const std::filesystem::path& directory){
+    //37x5 Truecolor and Alpha with a few more chunks after IHDR
+    std::vector<u8> pixels(37*5*4,100);
+    std::vector<u8> png;
+    CHECK(encodePNG(pixels.data(),37,5,6,png));
+    CHECK(writeTestFile(directory / "valid.png",png.data(),png.size()));
+    ParsedData data;
+    CHECK(Parser().probe(path(directory,"valid.png"),data));
+    CHECK(data.width == 37 && data.height == 5 && data.bpp == 8 && data.colorType == 6);
+    CHECK(data.compressionMethod == 0 && data.filterMethod == 0 && data.interlaceMethod == 0);
+    //nothing past IHDR is read
+    CHECK(data.compressedData.empty() && data.imageData.empty());
+
+    //exactly signature + IHDR is enough, one byte less is not
+    CHECK(writeTestFile(directory / "header.png",png.data(),33));
+    ParsedData header;
+    CHECK(Parser().probe(path(directory,"header.png"),header) && header.width == 37);
+    CHECK(writeTestFile(directory / "truncated.png",png.data(),32));
+    CHECK(!Parser().probe(path(directory,"truncated.png"),data));
+    CHECK(writeTestFile(directory / "empty.png",png.data(),0));
+    CHECK(!Parser().probe(path(directory,"empty.png"),data));
+
+    const char text[] = "this is a text file and not a png at all, but long enough";
+    CHECK(writeTestFile(directory / "text.png",text,sizeof(text)));
+    CHECK(!Parser().probe(path(directory,"text.png"),data));
+
+    //right signature, first chunk is not IHDR
+    std::vector<u8> wrongChunk = png;
+    std::memcpy(&wrongChunk[12],"IDAT",4);
+    CHECK(writeTestFile(directory / "nohdr.png",wrongChunk.data(),wrongChunk.size()));
+    CHECK(!Parser().probe(path(directory,"nohdr.png"),data));
+    //IHDR with the wrong length
+    std::vector<u8> wrongLength = png;
+    wrongLength[11] = 12;
+    CHECK(writeTestFile(directory / "length.png",wrongLength.data(),wrongLength.size()));
+    CHECK(!Parser().probe(path(directory,"length.png"),data));
+
+    CHECK(!Parser().probe(path(directory,"missing.png"),data));
+}
+
+static void testProbeBatch(const std::filesystem::path& directory){
+    std::vector<std::string> filepaths;
+    std::vector<u32> widths;
+    //valid files mixed with every kind of failure, more files than workers
+    for(u32 i=0;i<40;i++){
+        std::string name = "batch" + std::to_string(i) + ".png";
+        if(i % 4 == 3){
+            CHECK(writeTestFile(directory / name,"\x89PNG",4));
+            widths.push_back(0);
+        }else if(i % 8 == 5){
+            name = "absent" + std::to_string(i) + ".png";
+            widths.push_back(0);
+        }else{
+            u32 width = 1 + i;
+            std::vector<u8> pixels((size_t)width*2*3,(u8)i);
+            std::vector<u8> png;
+            CHECK(encodePNG(pixels.data(),width,2,2,png));
+            CHECK(writeTestFile(directory / name,png.data(),png.size()));
+            widths.push_back(width);
+        }
+        filepaths.push_back(path(directory,name.c_str()));
+    }
+    u32 expected = 0;
+    for(u32 width : widths){
+        expected += width != 0 ? 1 : 0;
+    }
+    const u32 threadCounts[3] = {1,4,0};
+    for(u32 threadCount : threadCounts){
+        std::vector<ParsedData> results;
+        std::vector<bool> succeeded;
+        CHECK(Parser().probeBatch(filepaths,results,succeeded,threadCount) == expected);
+        CHECK(results.size() == filepaths.size() && succeeded.size() == filepaths.size());
+        u32 mismatches = 0;
+        for(size_t i=0;i<filepaths.size() && i<results.size();i++){
+            bool ok = widths[i] != 0;
+            if(succeeded[i] != ok || (ok && (results[i].width != widths[i] || results[i].height != 2 || results[i].colorType != 2))){
+                mismatches++;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+    std::vector<ParsedData> results;
+    std::vector<bool> succeeded;
+    CHECK(Parser().probeBatch({},results,succeeded) == 0 && results.empty() && succeeded.empty());
+}
+
+static void testResources(const std::string& res){
+    struct Known{
+        const char* name;
+        u32 width;
+        u32 height;
+    };
+    const Known images[3] = {{"Blue.png",100,100},{"dbh.png",1920,1080},{"demon.png",700,671}};
+    for(const Known& image : images){
+        ParsedData data;
+        CHECK(Parser().probe(res + "/" + image.name,data) && data.width == image.width && data.height == image.height);
+    }
+}
+
+int main(int argc,char* argv[]){
+    std::filesystem::path directory = testDirectory("pngloader-probe");
+    testProbe(directory);
+    testProbeBatch(directory);
+    if(argc >= 2){
+        testResources(argv[1]);
+    }
+    std::error_code error;
+    std::filesystem::remove_all(directory,error);
+    return testResult("ProbeTests");
+}
@@ -0,0 +1,190 @@
+/*
+    The Inflater and the StreamDecoder fed in slices of every size:
+    known answer zlib streams split at every byte, a long Deflater stream split across its block headers,
+    and pngs decoded in slices compared with decoding them in one piece.
+*/
+#include "TestCheck.h"
+#include "Inflater.h"
+#include "StreamDecoder.h"
+#include "Deflater.h"
+#include "PNGEncoder.h"
+#include "Parser.h"
+#include <cstring>
+#include <algorithm>
+
+//Inflates in two pieces split at splitAt, returns false unless the stream finished
+static bool inflateSplit(const std::vector<u8>& input,size_t splitAt,bool zlibStream,std::vector<u8>& output){
+    output.clear();
+    Inflater inflater([&output](const u8* data,size_t size){
+        output.insert(output.end(),data,data + size);
+    },zlibStream);
+    Inflater::Status status = inflater.feed(input.data(),splitAt);
+    if(status == Inflater::INFLATE_NEED_INPUT){
+        status = inflater.feed(input.data() + splitAt,input.size() - splitAt);
+    }
+    return status == Inflater::INFLATE_DONE && inflater.finished();
+}
+
+static bool inflateBytewise(const std::vector<u8>& input,bool zlibStream,std::vector<u8>& output){
+    output.clear();
+    Inflater inflater([&output](const u8* data,size_t size){
+        output.insert(output.end(),data,data + size);
+    },zlibStream);
+    Inflater::Status status = Inflater::INFLATE_NEED_INPUT;
+    for(size_t i=0;i<input.size() && status == Inflater::INFLATE_NEED_INPUT;i++){
+        status = inflater.feed(input.data() + i,1);
+    }
+    return status == Inflater::INFLATE_DONE && inflater.finished();
+}
+
+static std::vector<u8> fromHex(const char* hex){
+    std::vector<u8> bytes;
+    for(size_t i=0;hex[i] && hex[i+1];i+=2){
+        bytes.push_back((u8)std::stoul(std::string(hex + i,2),nullptr,16));
+    }
+    return bytes;
+}
+
+static void testInflater(){
+    //zlib.compress output: a stored block, a fixed huffman block and a dynamic huffman block
+    std::vector<u8> dynamicText;
+    for(u32 i=0;i<120;i++){
+        dynamicText.insert(dynamicText.end(),1 + i%3,(u8)('a' + (i*i + 3*i)%7));
+    }
+    struct KnownAnswer{
+        const char* stream;
+        std::vector<u8> expected;
+    };
+    const KnownAnswer answers[3] = {
+        {"7801010200fdff6869013b00d2",{'h','i'}},
+        {"789ccb48cdc9c90700062c0215",{'h','e','l','l','o'}},
+        {"78dadd8ab10d000008836e2569fdff048967d88d026d92c238a8588923743ee78617e50220c85db6",dynamicText},
+    };
+    for(const KnownAnswer& answer : answers){
+        std::vector<u8> input = fromHex(answer.stream);
+        std::vector<u8> output;
+        for(size_t splitAt=0;splitAt<=input.size();splitAt++){
+            if(!CHECK(inflateSplit(input,splitAt,true,output) && output == answer.expected)){
+                std::cerr << "  stream " << answer.stream << " split at " << splitAt << "\n";
+            }
+        }
+        CHECK(inflateBytewise(input,true,output) && output == answer.expected);
+
+        //a wrong adler32 must not finish
+        std::vector<u8> corrupt = input;
+        corrupt.back() ^= 1;
+        CHECK(!inflateSplit(corrupt,corrupt.size()/2,true,output));
+        //and neither does a stream cut short
+        std::vector<u8> cut(input.begin(),input.end() - 1);
+        CHECK(!inflateSplit(cut,cut.size(),true,output));
+    }
+
+    //Deflater round trip, split everywhere in the first few KiB where the block headers are
+    std::mt19937 random(7);
+    std::vector<u8> data(20000);
+    for(size_t i=0;i<data.size();i++){
+        data[i] = (i % 1000 < 500) ? (u8)(i % 13) : (u8)random();
+    }
+    std::vector<u8> compressed = Deflater::compressZlib(data.data(),data.size());
+    std::vector<u8> output;
+    u32 splitFailures = 0;
+    for(size_t splitAt=0;splitAt<=compressed.size();splitAt += (splitAt < 4096 ? 1 : 97)){
+        if(!inflateSplit(compressed,splitAt,true,output) || output != data){
+            splitFailures++;
+        }
+    }
+    CHECK(splitFailures == 0);
+    CHECK(inflateBytewise(compressed,true,output) && output == data);
+}
+
+//Decodes png with the StreamDecoder fed in slices of sliceSize bytes, rows have to arrive in order
+static bool decodeSliced(const u8* png,size_t size,size_t sliceSize,std::vector<u8>& pixels,ImageHeader& header){
+    size_t rowBytes = 0;
+    u32 nextRow = 0;
+    bool inOrder = true;
+    pixels.clear();
+    StreamDecoder decoder(
+        [&](const ImageHeader& imageHeader){
+            header = imageHeader;
+            rowBytes = (size_t)imageHeader.width*(imageHeader.colorType == 6 ? 4 : 3);
+        },
+        [&](u32 y,const u8* row){
+            inOrder = inOrder && y == nextRow++;
+            pixels.insert(pixels.end(),row,row + rowBytes);
+        }
+    );
+    for(size_t offset=0;offset<size;offset+=sliceSize){
+        if(!decoder.feed(png + offset,std::min(sliceSize,size - offset))){
+            return false;
+        }
+    }
+    return decoder.finished() && inOrder && nextRow == header.height;
+}
+
+static void testSlices(){
+    std::mt19937 random(3);
+    const u32 width = 29;
+    const u32 height = 17;
+    std::vector<u8> pixels((size_t)width*height*4);
+    for(size_t i=0;i<pixels.size();i++){
+        pixels[i] = (u8)(i/7 + random() % 3);
+    }
+    std::vector<u8> png;
+    CHECK(encodePNG(pixels.data(),width,height,6,png));
+    //every slice size up to a whole chunk header and then some
+    u32 mismatches = 0;
+    for(size_t sliceSize=1;sliceSize<=64;sliceSize++){
+        std::vector<u8> decoded;
+        ImageHeader header;
+        if(!decodeSliced(png.data(),png.size(),sliceSize,decoded,header) || decoded != pixels){
+            mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+
+    //truncated anywhere, the decode never finishes
+    u32 finished = 0;
+    for(size_t size=0;size<png.size() - 12;size+=3){
+        std::vector<u8> decoded;
+        ImageHeader header;
+        finished += decodeSliced(png.data(),size,5,decoded,header) ? 1 : 0;
+    }
+    CHECK(finished == 0);
+    //anything after IEND is ignored
+    std::vector<u8> trailing = png;
+    trailing.insert(trailing.end(),100,0xAB);
+    std::vector<u8> decoded;
+    ImageHeader header;
+    CHECK(decodeSliced(trailing.data(),trailing.size(),11,decoded,header) && decoded == pixels);
+    const u8 text[] = "definitely not a png file";
+    CHECK(!decodeSliced(text,sizeof(text),4,decoded,header));
+}
+
+//Real encoder output, sliced decodes have to match decodePixels
+static void testResources(const std::string& res){
+    const char* names[2] = {"Blue.png","demon.png"};
+    for(const char* name : names){
+        std::vector<char> buffer;
+        if(!CHECK(Parser().readFile(res + "/" + name,buffer))){
+            continue;
+        }
+        std::vector<u8> whole;
+        ImageHeader header;
+        CHECK(decodePixels((const u8*)buffer.data(),buffer.size(),whole,header));
+        const size_t sliceSizes[3] = {1,4096,65536};
+        for(size_t sliceSize : sliceSizes){
+            std::vector<u8> sliced;
+            ImageHeader slicedHeader;
+            CHECK(decodeSliced((const u8*)buffer.data(),buffer.size(),sliceSize,sliced,slicedHeader) && sliced == whole);
+        }
+    }
+}
+
+int main(int argc,char* argv[]){
+    testInflater();
+    testSlices();
+    if(argc >= 2){
+        testResources(argv[1]);
+    }
+    return testResult("StreamDecoderTests");
+}
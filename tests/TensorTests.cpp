@@ -0,0 +1,198 @@
+/*
+    defilterScanline against a byte at a time reference for every filter type, the tensor row
+    kernels (premultiply, planar normalization, f16 through whichever conversion the cpu gets)
+    and decodeToTensor of encoded images.
+*/
+#include "TestCheck.h"
+#include "TensorOutput.h"
+#include "PNGEncoder.h"
+#include "Defilter.h"
+#include <cstring>
+#include <cmath>
+
+typedef unsigned short u16;
+
+//the filter type checked for every byte, as the png spec writes it
+static void referenceDefilter(const u8* filtered,u8 filterType,const u8* prevRow,u8* out,size_t rowBytes,u32 pixelBytes){
+    for(size_t i=0;i<rowBytes;i++){
+        u8 a = i >= pixelBytes ? out[i-pixelBytes] : 0;
+        u8 b = prevRow ? prevRow[i] : 0;
+        u8 c = (prevRow && i >= pixelBytes) ? prevRow[i-pixelBytes] : 0;
+        u8 value = filtered[i];
+        if(filterType == 1){
+            value += a;
+        }else if(filterType == 2){
+            value += b;
+        }else if(filterType == 3){
+            value += (a + b)/2;
+        }else if(filterType == 4){
+            value += paethPredictor(a,b,c);
+        }
+        out[i] = value;
+    }
+}
+
+static void testDefilter(){
+    std::mt19937 random(36);
+    const u32 pixelBytesList[2] = {3,4};
+    //shorter than a pixel, one pixel and rows long enough for any unrolling
+    const size_t rowLengths[4] = {1,4,75,1024};
+    u32 mismatches = 0;
+    for(u32 pixelBytes : pixelBytesList){
+        for(size_t rowBytes : rowLengths){
+            std::vector<u8> filtered(rowBytes);
+            std::vector<u8> prevRow(rowBytes);
+            std::vector<u8> out(rowBytes);
+            std::vector<u8> expected(rowBytes);
+            for(u8 filterType=0;filterType<5;filterType++){
+                for(u32 round=0;round<4;round++){
+                    for(size_t i=0;i<rowBytes;i++){
+                        filtered[i] = (u8)random();
+                        prevRow[i] = (u8)random();
+                    }
+                    //odd rounds are the first row of an image
+                    const u8* above = (round & 1) ? nullptr : prevRow.data();
+                    defilterScanline(filtered.data(),filterType,above,out.data(),rowBytes,pixelBytes);
+                    referenceDefilter(filtered.data(),filterType,above,expected.data(),rowBytes,pixelBytes);
+                    mismatches += out != expected ? 1 : 0;
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+static float halfToFloat(u16 half){
+    u32 exponent = (half >> 10) & 0x1f;
+    float mantissa = (float)(half & 0x3ff);
+    float value = exponent == 0 ? std::ldexp(mantissa,-24) : std::ldexp(mantissa + 1024,(int)exponent - 25);
+    return (half & 0x8000) ? -value : value;
+}
+
+static void testTensorKernels(){
+    //every value against every alpha, the rows are long enough for the vector path and its tail
+    const u32 width = 259;
+    std::vector<u8> row((size_t)width*4);
+    std::vector<u8> out((size_t)width*4);
+    TensorFormat premultiplied;
+    premultiplied.channels = 4;
+    premultiplied.premultiply = true;
+    u32 premultiplyFailures = 0;
+    for(u32 alpha=0;alpha<256;alpha++){
+        for(u32 x=0;x<width;x++){
+            row[x*4+0] = (u8)x;
+            row[x*4+1] = (u8)(255 - x);
+            row[x*4+2] = (u8)(x*7);
+            row[x*4+3] = (u8)alpha;
+        }
+        writeTensorRow(row.data(),4,0,width,1,premultiplied,out.data());
+        for(u32 i=0;i<width*4;i++){
+            u32 expected = (i % 4 == 3) ? alpha : (u32)std::lround(row[i]*alpha/255.0);
+            premultiplyFailures += out[i] != expected ? 1 : 0;
+        }
+    }
+    CHECK(premultiplyFailures == 0);
+
+    //rgb pixels to planar normalized floats
+    const u32 w = 5;
+    const u32 h = 2;
+    std::vector<u8> image((size_t)w*h*3);
+    for(size_t i=0;i<image.size();i++){
+        image[i] = (u8)(i*17);
+    }
+    TensorFormat normalized;
+    normalized.layout = TENSOR_PLANAR;
+    normalized.type = TENSOR_F32;
+    const float mean[3] = {0.485f,0.456f,0.406f};
+    const float std[3] = {0.229f,0.224f,0.225f};
+    normalized.setNormalization(mean,std);
+    std::vector<float> planar((size_t)w*h*3);
+    CHECK(tensorBytes(normalized,w,h) == planar.size()*sizeof(float));
+    for(u32 y=0;y<h;y++){
+        writeTensorRow(image.data() + (size_t)y*w*3,3,y,w,h,normalized,(u8*)planar.data());
+    }
+    u32 planarFailures = 0;
+    for(u32 c=0;c<3;c++){
+        for(size_t p=0;p<(size_t)w*h;p++){
+            float expected = (image[p*3+c]/255.0f - mean[c])/std[c];
+            planarFailures += std::fabs(planar[c*w*h + p] - expected) > 1e-5f ? 1 : 0;
+        }
+    }
+    CHECK(planarFailures == 0);
+
+    //f16 of the raw values, rgba from rgb gets alpha 255
+    TensorFormat halfFormat;
+    halfFormat.type = TENSOR_F16;
+    halfFormat.channels = 4;
+    const u8 pixels[6] = {0,1,2,128,255,3};
+    u16 halves[8];
+    writeTensorRow(pixels,3,0,2,1,halfFormat,(u8*)halves);
+    const u16 expected[8] = {0x0000,0x3c00,0x4000,0x5bf8,0x5800,0x5bf8,0x4200,0x5bf8};
+    CHECK(std::memcmp(halves,expected,sizeof(expected)) == 0);
+
+    //normalized f16 over a row long enough for the F16C loop, every value within half a half step
+    TensorFormat normalizedHalf;
+    normalizedHalf.type = TENSOR_F16;
+    normalizedHalf.setNormalization(mean,std);
+    std::vector<u16> halfRow((size_t)width*3);
+    writeTensorRow(row.data(),4,0,width,1,normalizedHalf,(u8*)halfRow.data());
+    u32 halfFailures = 0;
+    for(u32 x=0;x<width;x++){
+        for(u32 c=0;c<3;c++){
+            float exact = row[x*4+c]*normalizedHalf.scale[c] + normalizedHalf.bias[c];
+            halfFailures += std::fabs(halfToFloat(halfRow[x*3+c]) - exact) > std::fabs(exact)/2048 + 1e-7f ? 1 : 0;
+        }
+    }
+    CHECK(halfFailures == 0);
+}
+
+static void testDecodeToTensor(){
+    std::mt19937 random(6);
+    const u32 width = 41;
+    const u32 height = 9;
+    std::vector<u8> pixels((size_t)width*height*4);
+    for(u8& value : pixels){
+        value = (u8)random();
+    }
+    std::vector<u8> png;
+    if(!CHECK(encodePNG(pixels.data(),width,height,6,png))){
+        return;
+    }
+    //rgba interleaved u8 is the decoded image itself
+    TensorFormat interleaved;
+    interleaved.channels = 4;
+    size_t bytes = tensorBytes(interleaved,width,height);
+    std::unique_ptr<u8[],void(*)(u8*)> tensor = allocateTensor(bytes);
+    ImageHeader header;
+    CHECK(tensor && ((size_t)tensor.get() % 64) == 0);
+    CHECK(decodeToTensor(png.data(),png.size(),interleaved,tensor.get(),bytes,header));
+    CHECK(header.width == width && header.height == height);
+    CHECK(std::memcmp(tensor.get(),pixels.data(),bytes) == 0);
+
+    //planar rgb keeps every channel of every pixel
+    TensorFormat planar;
+    planar.layout = TENSOR_PLANAR;
+    bytes = tensorBytes(planar,width,height);
+    tensor = allocateTensor(bytes);
+    CHECK(decodeToTensor(png.data(),png.size(),planar,tensor.get(),bytes,header));
+    u32 mismatches = 0;
+    for(u32 c=0;c<3;c++){
+        for(size_t p=0;p<(size_t)width*height;p++){
+            mismatches += tensor[c*width*height + p] != pixels[p*4+c] ? 1 : 0;
+        }
+    }
+    CHECK(mismatches == 0);
+
+    //too small a buffer and channel counts other than 3 and 4 are refused
+    CHECK(!decodeToTensor(png.data(),png.size(),planar,tensor.get(),bytes - 1,header));
+    TensorFormat gray;
+    gray.channels = 1;
+    CHECK(!decodeToTensor(png.data(),png.size(),gray,tensor.get(),bytes,header));
+}
+
+int main(){
+    testDefilter();
+    testTensorKernels();
+    testDecodeToTensor();
+    return testResult("TensorTests");
+}
@@ -0,0 +1,50 @@
+#ifndef TESTCHECK
+#define TESTCHECK
+
+/*
+    Check helpers shared by the unit tests, every test file is its own executable.
+    A failed CHECK prints its file, line and expression and the test carries on,
+    testResult() prints the totals and turns them into the exit code.
+*/
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <filesystem>
+
+static unsigned int testFailures = 0;
+static unsigned int testChecks = 0;
+
+#define CHECK(condition) testCheck((condition),#condition,__FILE__,__LINE__)
+
+static inline bool testCheck(bool condition,const char* text,const char* file,int line){
+    testChecks++;
+    if(!condition){
+        std::cerr << file << ":" << line << ": check failed: " << text << "\n";
+        testFailures++;
+    }
+    return condition;
+}
+
+static inline int testResult(const char* name){
+    std::cout << name << ": " << testChecks << " checks, " << testFailures << " failed\n";
+    return testFailures == 0 ? 0 : 1;
+}
+
+//Empty directory under the system temp directory, the test removes it when done
+static inline std::filesystem::path testDirectory(const std::string& name){
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / (name + "-" + std::to_string(std::random_device()()));
+    std::error_code error;
+    std::filesystem::remove_all(directory,error);
+    std::filesystem::create_directories(directory,error);
+    return directory;
+}
+
+static inline bool writeTestFile(const std::filesystem::path& path,const void* data,size_t size){
+    std::ofstream ofs(path,std::ios::binary);
+    ofs.write((const char*)data,size);
+    return (bool)ofs;
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+    createThumbnail against a plain area average of the fully decoded image,
+    known answers for exact block averages, aspect ratios, alpha and color output.
+*/
+#include "TestCheck.h"
+#include "Thumbnail.h"
+#include "PNGEncoder.h"
+#include <cstdint>
+
+//Straightforward area average with the same band and column boundaries
+static std::vector<u8> referenceThumbnail(const std::vector<u8>& pixels,u32 width,u32 height,u32 pixelBytes,u32 thumbWidth,u32 thumbHeight){
+    std::vector<u8> out((size_t)thumbWidth*thumbHeight*3);
+    for(u32 ty=0;ty<thumbHeight;ty++){
+        u32 y0 = (u32)((uint64_t)ty*height/thumbHeight);
+        u32 y1 = (u32)((uint64_t)(ty+1)*height/thumbHeight);
+        for(u32 tx=0;tx<thumbWidth;tx++){
+            u32 x0 = (u32)((uint64_t)tx*width/thumbWidth);
+            u32 x1 = (u32)((uint64_t)(tx+1)*width/thumbWidth);
+            uint64_t count = (uint64_t)(x1-x0)*(y1-y0);
+            for(u32 c=0;c<3;c++){
+                uint64_t sum = 0;
+                for(u32 y=y0;y<y1;y++){
+                    for(u32 x=x0;x<x1;x++){
+                        sum += pixels[((size_t)y*width + x)*pixelBytes + c];
+                    }
+                }
+                out[((size_t)ty*thumbWidth + tx)*3 + c] = (u8)((sum + count/2)/count);
+            }
+        }
+    }
+    return out;
+}
+
+static std::vector<u8> encode(const std::vector<u8>& pixels,u32 width,u32 height,u8 colorType){
+    std::vector<u8> png;
+    CHECK(encodePNG(pixels.data(),width,height,colorType,png));
+    return png;
+}
+
+static void testKnownAnswers(){
+    //4x4 in 2x2 blocks, each block averages to a known value with rounding
+    const u8 values[4][4] = {{0,1,10,20},{1,1,30,40},{255,255,7,8},{255,254,8,8}};
+    std::vector<u8> pixels;
+    for(u32 y=0;y<4;y++){
+        for(u32 x=0;x<4;x++){
+            pixels.insert(pixels.end(),3,values[y][x]);
+        }
+    }
+    std::vector<u8> png = encode(pixels,4,4,2);
+    Thumbnail thumbnail;
+    CHECK(createThumbnail(png.data(),png.size(),2,thumbnail));
+    CHECK(thumbnail.width == 2 && thumbnail.height == 2 && thumbnail.pixels.size() == 12);
+    //(0+1+1+1)/4 = 0.75, (10+20+30+40)/4 = 25, (255*3+254)/4 = 254.75, (7+8+8+8)/4 = 7.75
+    const u8 expected[4] = {1,25,255,8};
+    for(u32 i=0;i<4 && thumbnail.pixels.size() == 12;i++){
+        CHECK(thumbnail.pixels[i*3] == expected[i] && thumbnail.pixels[i*3+2] == expected[i]);
+    }
+
+    //never upscaled, a larger maxSize gives the image itself
+    CHECK(createThumbnail(png.data(),png.size(),100,thumbnail));
+    CHECK(thumbnail.width == 4 && thumbnail.height == 4 && thumbnail.pixels == pixels);
+
+    //one pixel from everything
+    CHECK(createThumbnail(png.data(),png.size(),1,thumbnail));
+    CHECK(thumbnail.width == 1 && thumbnail.height == 1 && thumbnail.pixels[0] == (0+1+10+20+1+1+30+40+255+255+7+8+255+254+8+8 + 8)/16);
+}
+
+static void testAgainstReference(){
+    std::mt19937 random(5);
+    struct Case{
+        u32 width;
+        u32 height;
+        u8 colorType;
+        u32 maxSize;
+    };
+    //odd sizes so bands and columns have different widths, wide enough for the vector path
+    const Case cases[6] = {{37,23,2,10},{37,23,6,7},{100,10,2,10},{10,100,6,9},{257,3,2,64},{61,61,2,60}};
+    for(const Case& test : cases){
+        u32 pixelBytes = test.colorType == 6 ? 4 : 3;
+        std::vector<u8> pixels((size_t)test.width*test.height*pixelBytes);
+        for(u8& value : pixels){
+            value = (u8)random();
+        }
+        std::vector<u8> png = encode(pixels,test.width,test.height,test.colorType);
+        Thumbnail thumbnail;
+        if(!CHECK(createThumbnail(png.data(),png.size(),test.maxSize,thumbnail))){
+            continue;
+        }
+        u32 longest = std::max(test.width,test.height);
+        CHECK(thumbnail.width == std::max(1u,test.width*test.maxSize/longest));
+        CHECK(thumbnail.height == std::max(1u,test.height*test.maxSize/longest));
+        CHECK(thumbnail.pixels == referenceThumbnail(pixels,test.width,test.height,pixelBytes,thumbnail.width,thumbnail.height));
+    }
+}
+
+static void testColorAndErrors(){
+    //sRGB 128 everywhere, in linear light that is 55
+    std::vector<u8> pixels(8*8*3,128);
+    std::vector<u8> png = encode(pixels,8,8,2);
+    Thumbnail thumbnail;
+    CHECK(createThumbnail(png.data(),png.size(),4,thumbnail,COLOR_LINEAR) && thumbnail.pixels[0] == 55);
+    CHECK(createThumbnail(png.data(),png.size(),4,thumbnail,COLOR_SRGB) && thumbnail.pixels[0] == 128);
+
+    //cut off inside the image data, and not a png at all
+    CHECK(!createThumbnail(png.data(),png.size() - 20,4,thumbnail));
+    CHECK(thumbnail.width == 0 && thumbnail.pixels.empty());
+    const u8 text[] = "not a png";
+    CHECK(!createThumbnail(text,sizeof(text),4,thumbnail));
+}
+
+int main(){
+    testKnownAnswers();
+    testAgainstReference();
+    testColorAndErrors();
+    return testResult("ThumbnailTests");
+}